@@ -0,0 +1,362 @@
+#include "benchmark.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <array>
+#include "logger.h"
+#include "updatescheduler.h"
+#include "vertexarray.h"
+#include "renderer.h"
+#include "drawbatch.h"
+#include "meshoptimizer.h"
+#include "texture.h"
+#include "bitmap.h"
+#include "imagekernels.h"
+#include "threadpool.h"
+#include "mipchain.h"
+#include "compressedimage.h"
+
+// Keeps results alive so that the measured work is not optimized out
+static volatile float sink;
+
+template <typename F>
+double Benchmark::measure(F f, int repeats) {
+	double best = 0.0;
+	for (int i = 0; i < repeats; i++) {
+		double start = UpdateScheduler::timeFromEpoch();
+		f();
+		double curr = UpdateScheduler::timeFromEpoch() - start;
+		if (i == 0 || curr < best) best = curr;
+	}
+	return best;
+}
+
+void Benchmark::report(const std::string& name, double seconds, double count, const std::string& unit) {
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3) << "[Benchmark] " << name << ": " << seconds * 1000.0 << " ms";
+	if (count > 0) ss << " (" << seconds * 1e9 / count << " ns/" << unit << ")";
+	LogInfo(ss.str());
+}
+
+void Benchmark::run() {
+	LogInfo("Running benchmarks...");
+	vertexArray();
+	instancing();
+	drawBatch();
+	meshOptimizer();
+	imageKernels();
+	resample();
+	blockCompression();
+	mipmapGeneration();
+	LogInfo("Benchmarks finished.");
+}
+
+void Benchmark::vertexArray() {
+	const int Quads = 100000;
+	const float color[4] = { 0.0f, 0.6f, 1.0f, 1.0f };
+
+	VertexArray va(Quads * 6, VertexFormat(0, 4, 0, 3));
+	double runtime = measure([&]() {
+		va.clear();
+		for (int i = 0; i < Quads; i++) {
+			float x0 = float(i % 1000), y0 = float(i / 1000), x1 = x0 + 1.0f, y1 = y0 + 1.0f;
+			va.setColor(4, color);
+			va.addVertex({ x0, y0 });
+			va.addVertex({ x0, y1 });
+			va.addVertex({ x1, y0 });
+			va.addVertex({ x1, y0 });
+			va.addVertex({ x0, y1 });
+			va.addVertex({ x1, y1 });
+		}
+		sink = va.data()[va.vertexCount() * va.format().vertexAttributeCount - 1];
+	});
+	report("VertexArray::addVertex (runtime format)", runtime, Quads, "quad");
+
+	VertexArrayT<0, 4, 0, 2, VertexAttribFloat, VertexAttribUnsignedByte> vt(Quads * 4);
+	double typed = measure([&]() {
+		vt.clear();
+		for (int i = 0; i < Quads; i++) {
+			float x0 = float(i % 1000), y0 = float(i / 1000);
+			vt.setColor(color);
+			vt.addQuad(x0, y0, x0 + 1.0f, y0 + 1.0f);
+		}
+		sink = static_cast<const unsigned char*>(vt.data())[vt.vertexCount() * vt.format().vertexSize() - 1];
+	});
+	report("VertexArrayT::addQuad (compile-time format)", typed, Quads, "quad");
+
+	// Textured quads, emitted the way TextRenderer::drawAscii emits glyphs
+	VertexArray ga(Quads * 6, VertexFormat(2, 3, 0, 3));
+	runtime = measure([&]() {
+		ga.clear();
+		ga.setColor({ 0.0f, 0.0f, 0.0f });
+		for (int i = 0; i < Quads; i++) {
+			float x0 = float(i % 1000), y0 = float(i / 1000), x1 = x0 + 1.0f, y1 = y0 + 1.0f, tx = x0 / 1000.0f, ty = 0.0f, tw = 0.001f, th = 1.0f;
+			ga.setTexture({ tx, ty }); ga.addVertex({ x0, y0, 0.0f });
+			ga.setTexture({ tx, ty + th }); ga.addVertex({ x0, y1, 0.0f });
+			ga.setTexture({ tx + tw, ty }); ga.addVertex({ x1, y0, 0.0f });
+			ga.setTexture({ tx + tw, ty }); ga.addVertex({ x1, y0, 0.0f });
+			ga.setTexture({ tx, ty + th }); ga.addVertex({ x0, y1, 0.0f });
+			ga.setTexture({ tx + tw, ty + th }); ga.addVertex({ x1, y1, 0.0f });
+		}
+		sink = ga.data()[ga.vertexCount() * ga.format().vertexAttributeCount - 1];
+	});
+	report("VertexArray glyphs (runtime format)", runtime, Quads, "quad");
+
+	using GlyphVertexArray = VertexArrayT<2, 3, 0, 3, VertexAttribUnsignedShort, VertexAttribUnsignedByte>;
+	GlyphVertexArray gt(Quads * 4);
+	typed = measure([&]() {
+		gt.clear();
+		for (int i = 0; i < Quads; i++) {
+			float x0 = float(i % 1000), y0 = float(i / 1000), x1 = x0 + 1.0f, y1 = y0 + 1.0f, tx = x0 / 1000.0f, ty = 0.0f, tw = 0.001f, th = 1.0f;
+			GlyphVertexArray::Vertex* v = gt.addQuad();
+			v[0].setTexture(tx, ty); v[0].setCoordinates(x0, y0, 0.0f);
+			v[1].setTexture(tx, ty + th); v[1].setCoordinates(x0, y1, 0.0f);
+			v[2].setTexture(tx + tw, ty); v[2].setCoordinates(x1, y0, 0.0f);
+			v[3].setTexture(tx + tw, ty + th); v[3].setCoordinates(x1, y1, 0.0f);
+		}
+		sink = static_cast<const unsigned char*>(gt.data())[gt.vertexCount() * gt.format().vertexSize() - 1];
+	});
+	report("VertexArrayT glyphs (compile-time format)", typed, Quads, "quad");
+
+	std::stringstream ss;
+	ss << "[Benchmark] Bytes per quad: GUI " << va.format().vertexSize() * 6 << " -> " << vt.format().vertexSize() * 4
+	   << ", glyphs " << ga.format().vertexSize() * 6 << " -> " << gt.format().vertexSize() * 4;
+	LogInfo(ss.str());
+}
+
+void Benchmark::instancing() {
+	if (OpenGL::coreProfile()) {
+		LogInfo("[Benchmark] Instancing: skipped (no core profile shader)");
+		return;
+	}
+	const int Objects = 10000, Columns = 100;
+
+	VertexArrayT<0, 4, 0, 2, VertexAttribFloat, VertexAttribUnsignedByte> va(4);
+	va.setColor(1.0f, 1.0f, 1.0f, 1.0f);
+	va.addQuad(0.0f, 0.0f, 0.8f, 0.8f);
+	VertexBuffer quad(va, true);
+	std::vector<Mat4f> transforms(Objects);
+	std::vector<InstanceAttributes> attributes(Objects);
+	for (int i = 0; i < Objects; i++) {
+		transforms[i] = Mat4f::translation(Vec3f(float(i % Columns), float(i / Columns), 0.0f));
+		attributes[i].setTransform(transforms[i]);
+		attributes[i].setColor(float(i % Columns) / Columns, float(i / Columns) / Columns, 1.0f, 1.0f);
+	}
+	InstanceBuffer instances(attributes.data(), Objects, true);
+
+	Renderer::setProjection(Mat4f::ortho(0, float(Columns), 0, float(Objects / Columns), -1, 1));
+	// Current path: one transform update & draw call per object
+	double perObject = measure([&]() {
+		for (int i = 0; i < Objects; i++) {
+			Renderer::setModelview(transforms[i]);
+			quad.renderQuads();
+		}
+		Renderer::waitForComplete();
+	});
+	report("Per-object draws", perObject, Objects, "object");
+
+	Renderer::setModelview(Mat4f(1.0f));
+	ShaderProgram& shader = Renderer::instancedShader();
+	double instanced = measure([&]() {
+		shader.bind();
+		shader.setUniform1i("Textured", 0);
+		quad.renderQuadsInstanced(instances);
+		ShaderProgram::unbind();
+		Renderer::waitForComplete();
+	});
+	report(InstanceBuffer::supported() ? "Instanced draw" : "Instanced draw (fallback: one draw per instance)", instanced, Objects, "object");
+
+	Renderer::restoreProjection();
+	Renderer::restoreModelview();
+	Renderer::clear();
+}
+
+void Benchmark::drawBatch() {
+	const int Meshes = 5000, Columns = 100;
+	const VertexFormat format(0, 4, 0, 2);
+
+	// Small meshes (two triangles each) in separate vertex buffers & packed into a batch
+	std::vector<VertexBuffer> buffers(Meshes);
+	DrawBatch batch(format);
+	for (int i = 0; i < Meshes; i++) {
+		float x0 = float(i % Columns), y0 = float(i / Columns), x1 = x0 + 0.8f, y1 = y0 + 0.8f;
+		VertexArray va(6, format);
+		va.setColor({ x0 / Columns, y0 / Columns, 1.0f, 1.0f });
+		va.addVertex({ x0, y0 }); va.addVertex({ x0, y1 }); va.addVertex({ x1, y0 });
+		va.addVertex({ x1, y0 }); va.addVertex({ x0, y1 }); va.addVertex({ x1, y1 });
+		buffers[i].update(va, true);
+		batch.add(va);
+	}
+	batch.upload();
+
+	Renderer::setProjection(Mat4f::ortho(0, float(Columns), 0, float(Meshes / Columns), -1, 1));
+	Renderer::setModelview(Mat4f(1.0f));
+	double separate = measure([&]() {
+		for (const VertexBuffer& curr: buffers) curr.render();
+		Renderer::waitForComplete();
+	});
+	report("Separate vertex buffers", separate, Meshes, "mesh");
+	double batched = measure([&]() {
+		batch.render();
+		Renderer::waitForComplete();
+	});
+	const char* mode = DrawBatch::indirectSupported() ? "glMultiDrawArraysIndirect" : (DrawBatch::multiDrawSupported() ? "glMultiDrawArrays" : "loop");
+	report(std::string("DrawBatch (") + mode + ")", batched, Meshes, "mesh");
+
+	Renderer::restoreProjection();
+	Renderer::clear();
+}
+
+void Benchmark::meshOptimizer() {
+	const int Size = 256;
+	const VertexFormat format(2, 0, 3, 3);
+
+	// Grid triangle soup in shuffled order
+	std::vector<std::array<Vec3f, 3>> triangles;
+	triangles.reserve(Size * Size * 2);
+	for (int x = 0; x < Size; x++) for (int z = 0; z < Size; z++) {
+		Vec3f v00(float(x), 0.0f, float(z)), v01(float(x), 0.0f, float(z + 1));
+		Vec3f v10(float(x + 1), 0.0f, float(z)), v11(float(x + 1), 0.0f, float(z + 1));
+		triangles.push_back({ v00, v01, v10 });
+		triangles.push_back({ v10, v01, v11 });
+	}
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937(42));
+	VertexArray va(int(triangles.size()) * 3, format);
+	va.setNormal({ 0.0f, 1.0f, 0.0f });
+	for (const auto& curr: triangles) for (const Vec3f& v: curr) {
+		va.setTexture({ v.x / Size, v.z / Size });
+		va.addVertex({ v.x, v.y, v.z });
+	}
+
+	MeshOptimizer::Mesh mesh;
+	double seconds = measure([&]() {
+		mesh = MeshOptimizer::optimize(va.format(), va.data(), va.vertexCount());
+	}, 3);
+	report("Mesh optimizer", seconds, double(triangles.size()), "triangle");
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3) << "[Benchmark] Mesh optimizer: " << va.vertexCount() << " -> " << mesh.vertexCount
+	   << " vertexes, ACMR 3.000 -> " << MeshOptimizer::acmr(mesh.indexes.data(), int(mesh.indexes.size()));
+	LogInfo(ss.str());
+}
+
+void Benchmark::imageKernels() {
+	ImageKernels::Level best = ImageKernels::supportedLevel();
+	for (int size = 512; size <= 8192; size *= 4) {
+		TextureImage rgb(size, size, 3), rgba(size, size, 4), small(size / 2, size / 2, 4);
+		std::mt19937 rng(size);
+		for (int i = 0; i < size; i++) for (int j = 0; j < size; j++) for (int k = 0; k < 4; k++) {
+			unsigned char c = static_cast<unsigned char>(rng());
+			if (k < 3) rgb.color(j, i, k) = c;
+			rgba.color(j, i, k) = c;
+			if (i < size / 2 && j < size / 2) small.color(j, i, k) = c;
+		}
+
+		// Compare the scalar fallback with the best supported kernels, which must produce the same output
+		auto compare = [&](const std::string& name, auto f) {
+			TextureImage results[2];
+			double seconds[2];
+			ImageKernels::Level levels[2] = { ImageKernels::LevelScalar, best };
+			for (int i = 0; i < 2; i++) {
+				ImageKernels::setLevel(levels[i]);
+				seconds[i] = measure([&]() {
+					TextureImage res = f();
+					sink = res.data()[0];
+				}, 3);
+				results[i] = f();
+			}
+			ImageKernels::setLevel(best);
+			std::stringstream ss;
+			ss << name << " " << size << "x" << size;
+			for (int i = 0; i < 2; i++) report(ss.str() + " (" + ImageKernels::levelName(levels[i]) + ")", seconds[i], double(size) * size, "pixel");
+			size_t bytes = size_t(results[0].height()) * results[0].pitch();
+			if (memcmp(results[0].data(), results[1].data(), bytes) != 0) LogError("[Benchmark] " + ss.str() + ": results differ");
+		};
+		compare("RGB to RGBA", [&]() { return rgb.convert(4); });
+		compare("RGBA to RGB", [&]() { return rgba.convert(3); });
+		compare("BGR to RGB", [&]() {
+			TextureImage res(size, size, 3);
+			for (int i = 0; i < size; i++) ImageKernels::bgrToRGB(&rgb.color(0, i, 0), &res.color(0, i, 0), size);
+			return res;
+		});
+		compare("Shrink RGBA 2x", [&]() { return rgba.shrink(2); });
+		compare("Shrink RGB 2x", [&]() { return rgb.shrink(2); });
+		compare("Enlarge RGBA 2x", [&]() { return small.enlarge(2); });
+
+		Bitmap fills[2];
+		for (int i = 0; i < 2; i++) {
+			ImageKernels::setLevel(i == 0 ? ImageKernels::LevelScalar : best);
+			double seconds = measure([&]() {
+				Bitmap bmp(size, size, Vec3i(12, 34, 56));
+				sink = bmp.data[0];
+			}, 3);
+			fills[i] = Bitmap(size, size, Vec3i(12, 34, 56));
+			std::stringstream ss;
+			ss << "Solid fill RGB " << size << "x" << size << " (" << ImageKernels::levelName(ImageKernels::level()) << ")";
+			report(ss.str(), seconds, double(size) * size, "pixel");
+		}
+		ImageKernels::setLevel(best);
+		if (memcmp(fills[0].data, fills[1].data, size_t(fills[0].h) * fills[0].pitch) != 0) LogError("[Benchmark] Solid fill: results differ");
+	}
+}
+
+void Benchmark::resample() {
+	const int Size = 8192;
+	const char* FilterNames[] = { "nearest", "box", "bilinear", "Lanczos" };
+	TextureImage image(Size, Size, 4);
+	for (int i = 0; i < Size; i++) for (int j = 0; j < Size; j++) for (int k = 0; k < 4; k++)
+		image.color(j, i, k) = static_cast<unsigned char>((i ^ j) + k * 64);
+	TextureImage small = image.resample(512, 512);
+
+	std::stringstream threads;
+	threads << " (" << ThreadPool::threadCount() << " threads)";
+	for (int filter = TextureImage::FilterNearest; filter <= TextureImage::FilterLanczos; filter++) {
+		auto f = TextureImage::Filter(filter);
+		double down = measure([&]() { sink = image.resample(1024, 1024, f).data()[0]; }, 3);
+		report(std::string("Resample 8192x8192 -> 1024x1024, ") + FilterNames[filter] + threads.str(), down, double(Size) * Size, "source pixel");
+		double up = measure([&]() { sink = small.resample(2048, 2048, f).data()[0]; }, 3);
+		report(std::string("Resample 512x512 -> 2048x2048, ") + FilterNames[filter] + threads.str(), up, 2048.0 * 2048.0, "pixel");
+	}
+}
+
+void Benchmark::blockCompression() {
+	const int Size = 2048;
+	TextureImage image(Size, Size, 4);
+	for (int i = 0; i < Size; i++) for (int j = 0; j < Size; j++) for (int k = 0; k < 4; k++)
+		image.color(j, i, k) = static_cast<unsigned char>((i ^ j) + k * 64);
+	MipChain chain(image, -1);
+
+	std::stringstream threads;
+	threads << " (" << ThreadPool::threadCount() << " threads)";
+	double bc1 = measure([&]() { sink = CompressedImage(chain, CompressedImage::FormatBC1).data(0)[0]; }, 3);
+	report("Encode 2048x2048 with mipmaps, BC1" + threads.str(), bc1, double(Size) * Size, "base pixel");
+	double bc3 = measure([&]() { sink = CompressedImage(chain, CompressedImage::FormatBC3).data(0)[0]; }, 3);
+	report("Encode 2048x2048 with mipmaps, BC3" + threads.str(), bc3, double(Size) * Size, "base pixel");
+}
+
+void Benchmark::mipmapGeneration() {
+	const int Size = 2048;
+	TextureImage image(Size, Size, 4);
+	for (int i = 0; i < Size; i++) for (int j = 0; j < Size; j++) for (int k = 0; k < 4; k++)
+		image.color(j, i, k) = static_cast<unsigned char>((i * 3) ^ (j * 5) ^ (k * 64));
+
+	// Results depend on the driver (run with LIBGL_ALWAYS_SOFTWARE=1 for Mesa llvmpipe)
+	const GLubyte* name = glGetString(GL_RENDERER);
+	std::string renderer = std::string(" (") + (name != nullptr ? reinterpret_cast<const char*>(name) : "unknown renderer") + ")";
+	Texture texture;
+	double cpu = measure([&]() {
+		texture.load(image, true, true, -1, Texture::MipmapCPU);
+		Renderer::waitForComplete();
+	}, 3);
+	report("Texture::load 2048x2048 with mipmaps, CPU" + renderer, cpu, double(Size) * Size, "base pixel");
+	if (!Texture::generateMipmapSupported()) {
+		LogInfo("[Benchmark] glGenerateMipmap not supported, GPU mipmap generation skipped");
+		return;
+	}
+	double gpu = measure([&]() {
+		texture.load(image, true, true, -1, Texture::MipmapGPU);
+		Renderer::waitForComplete();
+	}, 3);
+	std::string storage = Texture::storageSupported() ? ", immutable storage" : "";
+	report("Texture::load 2048x2048 with mipmaps, GPU" + storage + renderer, gpu, double(Size) * Size, "base pixel");
+}
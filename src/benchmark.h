@@ -0,0 +1,28 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <string>
+
+// Performance measurements, enabled by setting "Benchmark.Run = 1" in the config file.
+// Results are written to the log.
+class Benchmark {
+public:
+	// Run all benchmarks. Must be called after OpenGL context is available!
+	static void run();
+
+private:
+	static void vertexArray();
+	static void instancing();
+	static void drawBatch();
+	static void meshOptimizer();
+	static void imageKernels();
+	static void resample();
+	static void blockCompression();
+	static void mipmapGeneration();
+
+	// Best time of several runs, in seconds
+	template <typename F> static double measure(F f, int repeats = 5);
+	static void report(const std::string& name, double seconds, double count, const std::string& unit);
+};
+
+#endif // !BENCHMARK_H_
@@ -1,7 +1,10 @@
 #include "bitmap.h"
 #include "logger.h"
+#include "mappedfile.h"
 
 #include <fstream>
+#include <vector>
+#include <cstdlib>
 
 #pragma pack(push)
 #pragma pack(1) // Avoid structure alignment
@@ -21,55 +24,46 @@ struct BitmapFileHeader {
 
 #pragma pack(pop)
 
-// Reverse Y axis
-void Bitmap::upsideDown() {
-	for (int i = 0; i < h / 2; i++) {
-		for (int j = 0; j < w; j++) {
-			int a = i * pitch + j * 3, b = (h - 1 - i) * pitch + j * 3;
-			std::swap(data[a], data[b]);
-			std::swap(data[a + 1], data[b + 1]);
-			std::swap(data[a + 2], data[b + 2]);
-		}
-	}
-}
-
-// Convert between BGR and RGB
-void Bitmap::swapRBChannels() {
-	int p = 0;
-	for (int i = 0; i < h; i++) {
-		for (int j = 0; j < w; j++) {
-			int ind = p + j * 3;
-			unsigned char t = data[ind];
-			data[ind] = data[ind + 2];
-			data[ind + 2] = t;
-		}
-		p += pitch;
+const unsigned char* Bitmap::parse(const MappedFile& file, int& width, int& height, int& pitch) {
+	BitmapFileHeader bfh;
+	BitmapInfoHeader bih;
+	if (file.size() < sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader)) return nullptr;
+	memcpy(&bfh, file.data(), sizeof(BitmapFileHeader));
+	memcpy(&bih, file.data() + sizeof(BitmapFileHeader), sizeof(BitmapInfoHeader));
+	if (bfh.bfType != 0x4D42 || bih.biBitCount != 24 || bih.biCompression != 0 || bih.biWidth <= 0 || bih.biHeight == 0) return nullptr;
+	width = bih.biWidth;
+	height = std::abs(bih.biHeight);
+	int rowBytes = (width * 3 + 3) / 4 * 4;
+	if (bfh.bfOffBits < 0 || size_t(bfh.bfOffBits) + size_t(rowBytes) * height > file.size()) return nullptr;
+	const unsigned char* res = file.data() + bfh.bfOffBits;
+	// Positive height: bottom-up rows
+	if (bih.biHeight > 0) {
+		pitch = -rowBytes;
+		return res + size_t(rowBytes) * (height - 1);
 	}
+	pitch = rowBytes;
+	return res;
 }
 
 void Bitmap::load(const std::string& filename) {
+	if (data != 0) delete[] data;
 	data = 0, w = h = 0;
-	std::ifstream bmpfile(filename.c_str(), std::ios::binary | std::ios::in);
-	if (!bmpfile.is_open()) {
+	MappedFile file;
+	if (!file.open(filename)) {
 		LogError("Could not open bitmap file \"" + filename + "\"");
 		return;
 	}
-	BitmapFileHeader bfh;
-	BitmapInfoHeader bih;
-	bmpfile.read((char*)&bfh, sizeof(BitmapFileHeader));
-	bmpfile.read((char*)&bih, sizeof(BitmapInfoHeader));
-	if (bih.biBitCount != 24) {
-		LogWarning("Failed to load file \"" + filename + "\" as PNG image: unsupported format (only PNG-8/24/32 is supported)");
+	int srcPitch = 0;
+	const unsigned char* src = parse(file, w, h, srcPitch);
+	if (src == nullptr) {
+		w = h = 0;
+		LogWarning("Failed to load file \"" + filename + "\" as bitmap image: unsupported format (only uncompressed 24-bit bitmaps are supported)");
 		return;
 	}
-	w = bih.biWidth;
-	h = bih.biHeight;
-	pitch = align(bih.biWidth * 3, 4);
+	pitch = align(w * 3, 4);
 	data = new unsigned char[size_t(1) * pitch * h];
-	bmpfile.read((char*)data, size_t(1) * pitch * h);
-	bmpfile.close();
-	swapRBChannels();
-	upsideDown();
+	// Flip & swizzle in one pass
+	for (int i = 0; i < h; i++) ImageKernels::bgrToRGB(src + ptrdiff_t(i) * srcPitch, data + size_t(i) * pitch, w);
 }
 
 void Bitmap::save(const std::string& filename) {
@@ -78,9 +72,6 @@ void Bitmap::save(const std::string& filename) {
 	bfh.bfSize = pitch * h + 54;
 	bih.biWidth = w;
 	bih.biHeight = h;
-	Bitmap tmp = *this;
-	tmp.upsideDown();
-	tmp.swapRBChannels();
 	std::ofstream ofs(filename, std::ios::out | std::ios::binary);
 	if (!ofs.is_open()) {
 		LogError("Could not open bitmap file \"" + filename + "\" for output");
@@ -88,7 +79,29 @@ void Bitmap::save(const std::string& filename) {
 	}
 	ofs.write((char*)&bfh, sizeof(BitmapFileHeader));
 	ofs.write((char*)&bih, sizeof(BitmapInfoHeader));
-	ofs.write((char*)tmp.data, pitch * h);
+	// Bottom-up BGR rows
+	std::vector<unsigned char> row(pitch, 0);
+	for (int i = h - 1; i >= 0; i--) {
+		ImageKernels::bgrToRGB(data + size_t(i) * pitch, row.data(), w);
+		ofs.write((char*)row.data(), pitch);
+	}
 	ofs.close();
 }
 
+bool Bitmap::saveBGR(const std::string& filename, const unsigned char* data, int width, int height) {
+	BitmapFileHeader bfh;
+	BitmapInfoHeader bih;
+	size_t bytes = size_t((width * 3 + 3) / 4 * 4) * height;
+	bfh.bfSize = int(bytes) + 54;
+	bih.biWidth = width;
+	bih.biHeight = height;
+	std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+	if (!ofs.is_open()) {
+		LogError("Could not open bitmap file \"" + filename + "\" for output");
+		return false;
+	}
+	ofs.write((char*)&bfh, sizeof(BitmapFileHeader));
+	ofs.write((char*)&bih, sizeof(BitmapInfoHeader));
+	ofs.write((const char*)data, std::streamsize(bytes));
+	return bool(ofs);
+}
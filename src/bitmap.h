@@ -4,6 +4,9 @@
 #include <string>
 #include <string.h>
 #include "vec.h"
+#include "imagekernels.h"
+
+class MappedFile;
 
 class Bitmap {
 public:
@@ -15,7 +18,9 @@ public:
 	Bitmap(int w_, int h_, const Vec3i& bg): w(w_), h(h_) {
 		pitch = align(w * 3, 4);
 		data = new unsigned char[pitch * h];
-		for (int i = 0; i < h; i++) for (int j = 0; j < w; j++) setPixel(j, i, bg);
+		unsigned char color[3] = { (unsigned char)bg.x, (unsigned char)bg.y, (unsigned char)bg.z };
+		if (h > 0) ImageKernels::fill(data, w, 3, color);
+		for (int i = 1; i < h; i++) memcpy(data + i * pitch, data, w * 3);
 	}
 	~Bitmap() { if (data != 0) delete[] data; }
 
@@ -40,14 +45,17 @@ public:
 	
 	void load(const std::string& filename);
 	void save(const std::string& filename);
+	// Write rows of BGR pixels laid out as in the file (bottom-up, 4-byte aligned pitch) without conversion
+	static bool saveBGR(const std::string& filename, const unsigned char* data, int width, int height);
+
+	// Top row of BGR pixel data in a mapped uncompressed 24-bit bitmap file (nullptr if unsupported).
+	// `pitch` is negative for files stored bottom-up.
+	static const unsigned char* parse(const MappedFile& file, int& width, int& height, int& pitch);
 	
 private:
 	int align(int x, int a) {
 		return x % a == 0 ? x : x + a - x % a;
 	}
-
-	void upsideDown();
-	void swapRBChannels();
 };
 
 #endif
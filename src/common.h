@@ -22,11 +22,19 @@
 #	define PROJECTNAME_TARGET_POSIX
 #endif
 
+// Architecture
+#if defined __x86_64__ || defined _M_X64 || defined __i386__ || defined _M_IX86
+#	define PROJECTNAME_ARCH_X86
+#elif defined __ARM_NEON || defined __ARM_NEON__
+#	define PROJECTNAME_ARCH_NEON
+#endif
+
 constexpr const char* RootPath = "./";
 constexpr const char* ConfigPath = "./";
 constexpr const char* ShaderPath = "./Shaders/";
 constexpr const char* FontPath = "./Fonts/";
 constexpr const char* ScreenshotPath = "./Screenshots/";
+constexpr const char* CachePath = "./Cache/";
 constexpr const char* ConfigFilename = "Config.ini";
 
 #endif // !COMMON_H_
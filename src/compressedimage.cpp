@@ -0,0 +1,271 @@
+#include "compressedimage.h"
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "common.h"
+#include "mipchain.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+#ifdef PROJECTNAME_TARGET_WINDOWS
+#	include <direct.h>
+#else
+#	include <sys/stat.h>
+#endif
+
+namespace {
+	// File layout: magic, version, format, level count, (width, height) of each level, then data of all levels.
+	// The version is also part of cache keys, bump it whenever the encoder output changes.
+	const uint32_t Magic = 0x54434342; // "BCCT"
+	const uint32_t Version = 1;
+
+	uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	void createDirectory(const std::string& path) {
+#ifdef PROJECTNAME_TARGET_WINDOWS
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	int quantize(float value, int max) { return std::min(std::max(int(value * max / 255.0f + 0.5f), 0), max); }
+	uint16_t pack565(const float* color) {
+		return uint16_t(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31));
+	}
+	void unpack565(uint16_t color, int* rgb) {
+		int r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+		rgb[0] = r << 3 | r >> 2, rgb[1] = g << 2 | g >> 4, rgb[2] = b << 3 | b >> 2;
+	}
+
+	// Pick the nearest of the four colors interpolated between endpoints for each pixel, returns squared error
+	int fitIndexes(const unsigned char* pixels, uint16_t c0, uint16_t c1, uint32_t& indexes) {
+		int palette[4][3];
+		unpack565(c0, palette[0]), unpack565(c1, palette[1]);
+		for (int k = 0; k < 3; k++) {
+			palette[2][k] = (palette[0][k] * 2 + palette[1][k]) / 3;
+			palette[3][k] = (palette[0][k] + palette[1][k] * 2) / 3;
+		}
+		int error = 0;
+		indexes = 0;
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 0;
+			for (int j = 0; j < 4; j++) {
+				int dr = pixels[i * 4] - palette[j][0], dg = pixels[i * 4 + 1] - palette[j][1], db = pixels[i * 4 + 2] - palette[j][2];
+				int curr = dr * dr + dg * dg + db * db;
+				if (j == 0 || curr < bestError) best = j, bestError = curr;
+			}
+			indexes |= uint32_t(best) << (i * 2);
+			error += bestError;
+		}
+		return error;
+	}
+
+	// Order endpoints for the four-color mode (c0 > c1) and fit indexes, returns squared error
+	int fitEndpoints(const unsigned char* pixels, uint16_t& c0, uint16_t& c1, uint32_t& indexes) {
+		if (c0 < c1) std::swap(c0, c1);
+		int error = fitIndexes(pixels, c0, c1, indexes);
+		// Equal endpoints select the three-color mode, where index 3 is transparent black
+		if (c0 == c1) indexes = 0;
+		return error;
+	}
+
+	// Endpoints along the principal axis of the block colors, refined once by least squares
+	void encodeColorBlock(const unsigned char* pixels, unsigned char* dst) {
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) for (int k = 0; k < 3; k++) mean[k] += pixels[i * 4 + k];
+		for (int k = 0; k < 3; k++) mean[k] /= 16.0f;
+		float cov[3][3] = {};
+		for (int i = 0; i < 16; i++) {
+			float d[3] = { pixels[i * 4] - mean[0], pixels[i * 4 + 1] - mean[1], pixels[i * 4 + 2] - mean[2] };
+			for (int j = 0; j < 3; j++) for (int k = 0; k < 3; k++) cov[j][k] += d[j] * d[k];
+		}
+		// Power iteration
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iter = 0; iter < 8; iter++) {
+			float next[3], norm = 0.0f;
+			for (int j = 0; j < 3; j++) {
+				next[j] = cov[j][0] * axis[0] + cov[j][1] * axis[1] + cov[j][2] * axis[2];
+				norm = std::max(norm, std::abs(next[j]));
+			}
+			if (norm < 1e-6f) break;
+			for (int j = 0; j < 3; j++) axis[j] = next[j] / norm;
+		}
+		float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		for (int j = 0; j < 3; j++) axis[j] /= length;
+
+		float tmin = 0.0f, tmax = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			float t = 0.0f;
+			for (int k = 0; k < 3; k++) t += (pixels[i * 4 + k] - mean[k]) * axis[k];
+			tmin = std::min(tmin, t), tmax = std::max(tmax, t);
+		}
+		// Inset the extremes, they are rarely hit exactly after quantization
+		float inset = (tmax - tmin) / 16.0f;
+		tmin += inset, tmax -= inset;
+		float e0[3], e1[3];
+		for (int k = 0; k < 3; k++) e0[k] = mean[k] + axis[k] * tmax, e1[k] = mean[k] + axis[k] * tmin;
+		uint16_t c0 = pack565(e0), c1 = pack565(e1);
+		uint32_t indexes;
+		int error = fitEndpoints(pixels, c0, c1, indexes);
+
+		// Least squares endpoints for the chosen indexes
+		if (error > 0 && c0 != c1) {
+			const float Weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0.0f, ab = 0.0f, bb = 0.0f, ap[3] = {}, bp[3] = {};
+			for (int i = 0; i < 16; i++) {
+				float a = Weights[indexes >> (i * 2) & 3], b = 1.0f - a;
+				aa += a * a, ab += a * b, bb += b * b;
+				for (int k = 0; k < 3; k++) ap[k] += a * pixels[i * 4 + k], bp[k] += b * pixels[i * 4 + k];
+			}
+			float det = aa * bb - ab * ab;
+			if (std::abs(det) > 1e-6f) {
+				for (int k = 0; k < 3; k++) {
+					e0[k] = (ap[k] * bb - bp[k] * ab) / det;
+					e1[k] = (bp[k] * aa - ap[k] * ab) / det;
+				}
+				uint16_t r0 = pack565(e0), r1 = pack565(e1);
+				uint32_t refined;
+				if (fitEndpoints(pixels, r0, r1, refined) < error) c0 = r0, c1 = r1, indexes = refined;
+			}
+		}
+		dst[0] = c0 & 0xFF, dst[1] = c0 >> 8, dst[2] = c1 & 0xFF, dst[3] = c1 >> 8;
+		for (int i = 0; i < 4; i++) dst[4 + i] = (indexes >> (i * 8)) & 0xFF;
+	}
+
+	// Eight-value mode: alpha interpolated between the block extremes
+	void encodeAlphaBlock(const unsigned char* pixels, unsigned char* dst) {
+		int lo = 255, hi = 0;
+		for (int i = 0; i < 16; i++) lo = std::min(lo, int(pixels[i * 4 + 3])), hi = std::max(hi, int(pixels[i * 4 + 3]));
+		int palette[8] = { hi, lo };
+		for (int i = 2; i < 8; i++) palette[i] = ((8 - i) * hi + (i - 1) * lo + 3) / 7;
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			for (int j = 1; j < 8; j++) if (std::abs(pixels[i * 4 + 3] - palette[j]) < std::abs(pixels[i * 4 + 3] - palette[best])) best = j;
+			bits |= uint64_t(best) << (i * 3);
+		}
+		dst[0] = static_cast<unsigned char>(hi), dst[1] = static_cast<unsigned char>(lo);
+		for (int i = 0; i < 6; i++) dst[2 + i] = (bits >> (i * 8)) & 0xFF;
+	}
+
+	// Copy block into RGBA pixels, repeating edge pixels of partial blocks.
+	// Single channel pixels are masks with `alpha`, gray without (like Texture::formats()).
+	void gatherBlock(const MipChain& chain, int level, int bx, int by, bool alpha, unsigned char* block) {
+		int bpp = chain.bytesPerPixel(), pitch = chain.pitch(level);
+		const unsigned char* src = chain.data(level);
+		for (int y = 0; y < 4; y++) for (int x = 0; x < 4; x++) {
+			int sx = std::min(bx * 4 + x, chain.width(level) - 1), sy = std::min(by * 4 + y, chain.height(level) - 1);
+			const unsigned char* p = src + size_t(sy) * pitch + sx * bpp;
+			unsigned char* q = block + (y * 4 + x) * 4;
+			if (bpp >= 3) q[0] = p[0], q[1] = p[1], q[2] = p[2], q[3] = bpp == 4 ? p[3] : 255;
+			else if (bpp == 2) q[0] = q[1] = q[2] = p[0], q[3] = p[1];
+			else if (alpha) q[0] = q[1] = q[2] = 255, q[3] = p[0];
+			else q[0] = q[1] = q[2] = p[0], q[3] = 255;
+		}
+	}
+}
+
+CompressedImage::CompressedImage(const MipChain& chain, Format format): mFormat(format) {
+	std::vector<std::pair<int, int>> sizes;
+	for (int i = 0; i < chain.levels(); i++) sizes.emplace_back(chain.width(i), chain.height(i));
+	allocate(sizes);
+	for (int level = 0; level < levels(); level++) {
+		int blocksX = (width(level) + 3) / 4, blocksY = (height(level) + 3) / 4;
+		unsigned char* dst = mData.data() + mLevels[level].offset;
+		ThreadPool::parallelFor(blocksY, std::max(256 / blocksX, 1), [&](int begin, int end) {
+			unsigned char block[64];
+			for (int by = begin; by < end; by++) for (int bx = 0; bx < blocksX; bx++) {
+				gatherBlock(chain, level, bx, by, mFormat == FormatBC3, block);
+				unsigned char* out = dst + size_t(by) * pitch(level) + bx * blockBytes();
+				if (mFormat == FormatBC3) {
+					encodeAlphaBlock(block, out);
+					out += 8;
+				}
+				encodeColorBlock(block, out);
+			}
+		});
+	}
+}
+
+void CompressedImage::allocate(const std::vector<std::pair<int, int>>& sizes) {
+	mLevels.clear();
+	size_t offset = 0;
+	for (const auto& curr: sizes) {
+		mLevels.push_back({ curr.first, curr.second, offset });
+		offset += size(levels() - 1);
+	}
+	mData.resize(offset);
+}
+
+bool CompressedImage::hashFile(const std::string& filename, uint64_t& hash) {
+	MappedFile file;
+	if (!file.open(filename, true)) return false;
+	hash = fnv1a(file.data(), file.size());
+	return true;
+}
+
+std::string CompressedImage::cacheFilename(uint64_t contentHash, const std::string& options) {
+	uint64_t hash = fnv1a(options.data(), options.size(), contentHash);
+	hash = fnv1a(&Version, sizeof(Version), hash);
+	std::stringstream ss;
+	ss << CachePath << std::hex << std::setw(16) << std::setfill('0') << hash << ".bct";
+	return ss.str();
+}
+
+bool CompressedImage::load(const std::string& filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) return false;
+	uint32_t header[4];
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!in || header[0] != Magic || header[1] != Version || header[2] > FormatBC3 || header[3] == 0 || header[3] > 32) return false;
+	std::vector<std::pair<int, int>> sizes(header[3]);
+	for (auto& curr: sizes) {
+		int32_t size[2];
+		in.read(reinterpret_cast<char*>(size), sizeof(size));
+		if (!in || size[0] <= 0 || size[1] <= 0) return false;
+		curr = std::make_pair(size[0], size[1]);
+	}
+	mFormat = Format(header[2]);
+	allocate(sizes);
+	in.read(reinterpret_cast<char*>(mData.data()), std::streamsize(mData.size()));
+	if (!in) {
+		mLevels.clear(), mData.clear();
+		return false;
+	}
+	return true;
+}
+
+bool CompressedImage::save(const std::string& filename) const {
+	size_t slash = filename.find_last_of("/\\");
+	if (slash != std::string::npos) createDirectory(filename.substr(0, slash));
+	// Write under a temporary name, so that concurrent loads never see partial files
+	std::stringstream ss;
+	ss << filename << '.' << std::hex << reinterpret_cast<uintptr_t>(this) << ".tmp";
+	std::string temp = ss.str();
+	{
+		std::ofstream out(temp, std::ios::binary);
+		uint32_t header[4] = { Magic, Version, uint32_t(mFormat), uint32_t(levels()) };
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		for (const Level& curr: mLevels) {
+			int32_t size[2] = { curr.width, curr.height };
+			out.write(reinterpret_cast<const char*>(size), sizeof(size));
+		}
+		out.write(reinterpret_cast<const char*>(mData.data()), std::streamsize(mData.size()));
+		if (!out) {
+			out.close();
+			std::remove(temp.c_str());
+			return false;
+		}
+	}
+	// Fails on some platforms when another thread got there first, which is just as good
+	if (std::rename(temp.c_str(), filename.c_str()) != 0) std::remove(temp.c_str());
+	return true;
+}
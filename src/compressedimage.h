@@ -0,0 +1,59 @@
+#ifndef COMPRESSEDIMAGE_H_
+#define COMPRESSEDIMAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "opengl.h"
+
+class MipChain;
+
+// Block-compressed (S3TC) mip chain, encoded on the CPU and cached on disk.
+// BC1 stores opaque RGB in 8 bytes per 4x4 block, BC3 adds an interpolated alpha block (16 bytes).
+class CompressedImage {
+public:
+	enum Format { FormatBC1, FormatBC3 };
+
+	CompressedImage() = default;
+	// Encode all levels of the chain, parallelized by block rows. Single channel levels are masks for BC3, gray for BC1.
+	CompressedImage(const MipChain& chain, Format format);
+
+	// Whether the OpenGL context can sample block-compressed textures
+	static bool supported() { return GLEW_EXT_texture_compression_s3tc != 0; }
+	// Hash of file contents (FNV-1a), false when the file cannot be read
+	static bool hashFile(const std::string& filename, uint64_t& hash);
+	// Cache file for source file contents (see hashFile()) and encoding options
+	static std::string cacheFilename(uint64_t contentHash, const std::string& options);
+
+	bool load(const std::string& filename);
+	bool save(const std::string& filename) const;
+
+	bool empty() const { return mLevels.empty(); }
+	Format format() const { return mFormat; }
+	GLenum internalFormat() const {
+		return mFormat == FormatBC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	int blockBytes() const { return mFormat == FormatBC1 ? 8 : 16; }
+	int levels() const { return int(mLevels.size()); }
+	int width(int level) const { return mLevels[level].width; }
+	int height(int level) const { return mLevels[level].height; }
+	// Bytes per row of blocks
+	int pitch(int level) const { return (mLevels[level].width + 3) / 4 * blockBytes(); }
+	int size(int level) const { return pitch(level) * ((mLevels[level].height + 3) / 4); }
+	const unsigned char* data(int level) const { return mData.data() + mLevels[level].offset; }
+
+private:
+	struct Level {
+		int width, height;
+		size_t offset;
+	};
+
+	Format mFormat = FormatBC1;
+	std::vector<Level> mLevels;
+	std::vector<unsigned char> mData;
+
+	// Lay out levels of the given sizes and allocate their storage
+	void allocate(const std::vector<std::pair<int, int>>& sizes);
+};
+
+#endif // !COMPRESSEDIMAGE_H_
@@ -0,0 +1,79 @@
+#include "drawbatch.h"
+#include <cstring>
+
+int DrawBatch::add(const void* data, int vertexes) {
+	Assert(mBuffer.empty(), "Mesh added to a DrawBatch already uploaded");
+	size_t stride = mFormat.vertexSize(), offset = mData.size();
+	mFirst.push_back(mCount.empty() ? 0 : mFirst.back() + mCount.back());
+	mCount.push_back(vertexes);
+	mData.resize(offset + vertexes * stride);
+	if (vertexes > 0) memcpy(mData.data() + offset, data, vertexes * stride);
+	return int(mFirst.size()) - 1;
+}
+
+void DrawBatch::upload(bool staticDraw) {
+	int vertexes = mCount.empty() ? 0 : mFirst.back() + mCount.back();
+	mBuffer.update(mFormat, mData.data(), vertexes, staticDraw);
+	std::vector<unsigned char>().swap(mData);
+
+	if (!indirectSupported() || mFirst.empty()) return;
+	std::vector<DrawArraysIndirectCommand> commands(mFirst.size());
+	for (size_t i = 0; i < mFirst.size(); i++) commands[i] = { GLuint(mCount[i]), 1, GLuint(mFirst[i]), 0 };
+	if (mAllCommands == 0) glGenBuffers(1, &mAllCommands);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mAllCommands);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data(),
+				 staticDraw ? GL_STATIC_DRAW : GL_STREAM_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void DrawBatch::clear() {
+	mData.clear();
+	mFirst.clear();
+	mCount.clear();
+	mBuffer.destroy();
+	if (mAllCommands != 0) glDeleteBuffers(1, &mAllCommands);
+	if (mSubsetCommands != 0) glDeleteBuffers(1, &mSubsetCommands);
+	mAllCommands = mSubsetCommands = 0;
+}
+
+void DrawBatch::draw(const GLint* first, const GLsizei* count, int drawCount, VertexBufferID commands) const {
+	if (drawCount == 0 || mBuffer.empty()) return;
+	mBuffer.bind();
+	if (commands != 0) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+		glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, drawCount, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	} else if (multiDrawSupported()) {
+		glMultiDrawArrays(GL_TRIANGLES, first, count, drawCount);
+	} else {
+		for (int i = 0; i < drawCount; i++) glDrawArrays(GL_TRIANGLES, first[i], count[i]);
+	}
+}
+
+void DrawBatch::render() const {
+	draw(mFirst.data(), mCount.data(), meshCount(), mAllCommands);
+}
+
+void DrawBatch::render(const std::vector<int>& meshes) const {
+	if (meshes.empty()) return;
+	if (indirectSupported()) {
+		// Build commands on the CPU, upload into an orphaned buffer
+		mSubsetIndirect.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+			mSubsetIndirect[i] = { GLuint(mCount[meshes[i]]), 1, GLuint(mFirst[meshes[i]]), 0 };
+		if (mSubsetCommands == 0) glGenBuffers(1, &mSubsetCommands);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mSubsetCommands);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, mSubsetIndirect.size() * sizeof(DrawArraysIndirectCommand), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, mSubsetIndirect.size() * sizeof(DrawArraysIndirectCommand), mSubsetIndirect.data());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		draw(nullptr, nullptr, int(meshes.size()), mSubsetCommands);
+		return;
+	}
+	mSubsetFirst.resize(meshes.size());
+	mSubsetCount.resize(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		mSubsetFirst[i] = mFirst[meshes[i]];
+		mSubsetCount[i] = mCount[meshes[i]];
+	}
+	draw(mSubsetFirst.data(), mSubsetCount.data(), int(meshes.size()), 0);
+}
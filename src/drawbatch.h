@@ -0,0 +1,70 @@
+#ifndef DRAWBATCH_H_
+#define DRAWBATCH_H_
+
+#include <vector>
+#include "opengl.h"
+#include "vertexarray.h"
+
+// Many small meshes sharing a vertex format, packed into one vertex buffer.
+// Meshes are drawn together with glMultiDrawArraysIndirect when available, glMultiDrawArrays otherwise.
+class DrawBatch {
+public:
+	explicit DrawBatch(const VertexFormat& format): mFormat(format) {}
+	~DrawBatch() { clear(); }
+
+	DrawBatch(const DrawBatch&) = delete;
+	DrawBatch& operator=(const DrawBatch&) = delete;
+
+	// Add mesh (triangles), returns its index. Not allowed after upload() until clear()!
+	int add(const void* data, int vertexes);
+	int add(const VertexArray& va) {
+		Assert(va.format() == mFormat);
+		return add(va.data(), va.vertexCount());
+	}
+	template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+			  VertexAttribType TexType, VertexAttribType ColType, VertexAttribType NormType, VertexAttribType CoordType>
+	int add(const VertexArrayT<Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType>& va) {
+		Assert(va.format() == mFormat);
+		return add(va.data(), va.vertexCount());
+	}
+	// Upload packed meshes, releasing the copy kept in memory
+	void upload(bool staticDraw = true);
+	// Remove all meshes
+	void clear();
+
+	// Get mesh count
+	int meshCount() const { return int(mFirst.size()); }
+	// Draw all meshes
+	void render() const;
+	// Draw given meshes
+	void render(const std::vector<int>& meshes) const;
+
+	// Multi-draw mode in use
+	static bool indirectSupported() { return GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect; }
+	static bool multiDrawSupported() { return GLEW_VERSION_1_4 != 0; }
+
+private:
+	// Layout of glMultiDrawArraysIndirect commands
+	struct DrawArraysIndirectCommand {
+		GLuint count, instanceCount, first, baseInstance;
+	};
+
+	VertexFormat mFormat;
+	// Packed vertex data until upload
+	std::vector<unsigned char> mData;
+	// First vertex & vertex count of each mesh
+	std::vector<GLint> mFirst;
+	std::vector<GLsizei> mCount;
+	VertexBuffer mBuffer;
+	// Indirect commands drawing all meshes, and for subsets (rebuilt on each draw)
+	VertexBufferID mAllCommands = 0;
+	mutable VertexBufferID mSubsetCommands = 0;
+	// Scratch arrays for subsets, kept to avoid allocations
+	mutable std::vector<GLint> mSubsetFirst;
+	mutable std::vector<GLsizei> mSubsetCount;
+	mutable std::vector<DrawArraysIndirectCommand> mSubsetIndirect;
+
+	void draw(const GLint* first, const GLsizei* count, int drawCount, VertexBufferID commands) const;
+};
+
+#endif // !DRAWBATCH_H_
@@ -0,0 +1,40 @@
+#include "framearena.h"
+#include <algorithm>
+#include "debug.h"
+
+constexpr size_t FrameArena::DefaultBlockSize;
+std::vector<FrameArena::Block> FrameArena::mBlocks;
+size_t FrameArena::mOffset = 0, FrameArena::mUsed = 0;
+
+void FrameArena::addBlock(size_t size) {
+	mBlocks.push_back(Block{ new unsigned char[size], size });
+	mOffset = 0;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+	Assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= alignof(std::max_align_t));
+	if (mBlocks.empty()) addBlock(DefaultBlockSize);
+	size_t offset = (mOffset + alignment - 1) & ~(alignment - 1);
+	if (offset + size > mBlocks.back().size) {
+		addBlock(std::max(size, mBlocks.back().size * 2));
+		offset = 0;
+	}
+	mUsed += offset - mOffset + size;
+	mOffset = offset + size;
+	return mBlocks.back().data + offset;
+}
+
+void FrameArena::reset() {
+	if (mBlocks.empty()) return;
+	// Merge blocks after growth, shrink after a peak (e.g. a one-off large allocation)
+	size_t size = mBlocks.back().size;
+	if (mBlocks.size() > 1) size = mUsed + mUsed / 2;
+	else if (size > DefaultBlockSize && mUsed * 4 < size) size = mUsed * 2;
+	size = std::max(size, DefaultBlockSize);
+	if (mBlocks.size() > 1 || size != mBlocks.back().size) {
+		for (Block& curr: mBlocks) delete[] curr.data;
+		mBlocks.clear();
+		addBlock(size);
+	}
+	mOffset = mUsed = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef FRAMEARENA_H_
+#define FRAMEARENA_H_
+
+#include <cstddef>
+#include <vector>
+
+// Linear allocator for transient per-frame data (GUI & text geometry...)
+// Everything allocated is released at once by reset(), called at the start of each frame.
+// Blocks are merged on reset so that steady-state frames do not allocate from the heap at all.
+class FrameArena {
+public:
+	// Allocate memory valid until the next reset()
+	static void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	template <typename T> static T* allocate(size_t count) {
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+	// Release all allocations
+	static void reset();
+	// Bytes allocated since last reset
+	static size_t used() { return mUsed; }
+
+private:
+	static constexpr size_t DefaultBlockSize = 256 * 1024;
+
+	struct Block {
+		unsigned char* data;
+		size_t size;
+	};
+
+	// Blocks in use, allocating from the last one
+	static std::vector<Block> mBlocks;
+	// Offset in the last block
+	static size_t mOffset;
+	// Bytes allocated since last reset (including alignment)
+	static size_t mUsed;
+
+	static void addBlock(size_t size);
+};
+
+#endif // !FRAMEARENA_H_
@@ -1,6 +1,8 @@
 #include "gui.h"
 #include <algorithm>
 #include "renderer.h"
+#include "streamingvertexbuffer.h"
+#include "renderqueue.h"
 #include "logger.h"
 #include "textrenderer.h"
 #include "config.h"
@@ -64,24 +66,47 @@ namespace GUI {
 		PictureBoxBorderWidth = int(PictureBoxBorderWidth1 * scaling + 0.5f);
 	}
 
+	// Vertex arrays for plain & textured elements: 8-bit colors, 2D coordinates (fractional under scaling)
+	using ColorVertexArray = VertexArrayT<0, 4, 0, 2, VertexAttribFloat, VertexAttribUnsignedByte>;
+	using PictureVertexArray = VertexArrayT<2, 4, 0, 2, VertexAttribFloat, VertexAttribUnsignedByte>;
+
 	// Add a quad to vertex array
-	inline void drawQuad(VertexArray& va, float x0, float y0, float x1, float y1) {
-		va.addVertex({ float(x0), float(y0) });
-		va.addVertex({ float(x0), float(y1) });
-		va.addVertex({ float(x1), float(y0) });
-		va.addVertex({ float(x1), float(y0) });
-		va.addVertex({ float(x0), float(y1) });
-		va.addVertex({ float(x1), float(y1) });
+	inline void drawQuad(ColorVertexArray& va, float x0, float y0, float x1, float y1) {
+		va.addQuad(x0, y0, x1, y1);
+	}
+
+	// Render queue layers: each control gets LayersPerControl layers above its parent's.
+	// Sibling controls share layers, so they must not overlap (see RenderQueue)
+	const int LayerBackground = 0, LayerText = 1, LayerForeground = 2, LayersPerControl = 3;
+	// First layer of the control being rendered
+	int LayerBase = 0;
+
+	// Queue quads on a layer of the current control
+	template <typename VertexArrayType>
+	inline void submitQuads(const VertexArrayType& va, int layer, TextureID texture = 0) {
+		RenderQueue::State state;
+		state.layer = LayerBase + layer;
+		state.texture = texture;
+		RenderQueue::submitQuads(state, va);
 	}
 
-	// Draw string using TextRenderer::drawAscii
+	// Queue string using TextRenderer::submitAscii
 	inline void drawTextCentered(const Point2D& ul, const Point2D& lr, const std::string& s, const Vec3f& col, const Vec3f& bgcol) {
 		float size = std::round(float(Config::getDouble("GUI.FontSize", 10.5)) * ScalingFactor);
 		float bheight = TextRenderer::getBoxHeight(size, s), bwidth = TextRenderer::getBoxWidth(size, s);
 		Vec3f pos(std::round((ul.x + lr.x - bwidth) / 2.0f), std::round((ul.y + lr.y + bheight) / 2.0f), 0.0f);
-		Renderer::enableTexture2D();
-		TextRenderer::drawAscii(pos, s, size, col, bgcol);
-		Renderer::disableTexture2D();
+		TextRenderer::submitAscii(LayerBase + LayerText, pos, s, size, col, bgcol);
+	}
+
+	void Control::renderAll(const Point2D& parentPos, const Point2D& parentSize, const Form& form, unsigned int channel) const {
+		Point2D ul = upperLeft.compute(parentSize) + parentPos;
+		Point2D lr = lowerRight.compute(parentSize) + parentPos;
+		if (active) {
+			render(ul, lr, form);
+			LayerBase += LayersPerControl;
+			for (const Control* c: mChildren) c->renderAll(ul, lr - ul, form, channel);
+			LayerBase -= LayersPerControl;
+		}
 	}
 
 	bool Control::focused(const Form& form) const { return focusable && this == form.focus(); }
@@ -113,7 +138,9 @@ namespace GUI {
 	}
 	
 	void Form::render(const Window&, const Point2D& pos, const Point2D& size) const {
+		LayerBase = 0;
 		area->renderAll(pos, size, *this);
+		RenderQueue::flush();
 	}
 	
 	void ClipArea::updateAll(const Point2D& parentPos, const Point2D& parentSize, Form& form) {
@@ -131,19 +158,23 @@ namespace GUI {
 		Point2D ul = upperLeft.compute(parentSize) + parentPos;
 		Point2D lr = lowerRight.compute(parentSize) + parentPos;
 		if (active) {
-			VertexArray va(120, VertexFormat(0, 4, 0, 3));
-			va.setColor({ 0.0f, 0.0f, 0.0f, 0.0f });
+			ColorVertexArray va(4);
+			va.setColor(0.0f, 0.0f, 0.0f, 0.0f);
 			drawQuad(va, ul.x, ul.y, lr.x, lr.y);
-			VertexBuffer vb(va);
+			// Stencil state changes: draw everything queued outside of the clip area first
+			RenderQueue::flush();
 //			glStencilFunc(GL_EQUAL, channel, 0xFF); // (This should have been done)
 			glStencilOp(GL_KEEP, GL_KEEP, GL_INCR_WRAP);
-			vb.render(); // Initialize clip area
+			StreamingVertexBuffer::renderQuads(va); // Initialize clip area
 			glStencilFunc(GL_EQUAL, channel + 1, 0xFF);
 			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+			LayerBase += LayersPerControl;
 			for (const Control* c: realChildren()) c->renderAll(ul, lr - ul, form, channel + 1);
+			LayerBase -= LayersPerControl;
+			RenderQueue::flush();
 //			glStencilFunc(GL_EQUAL, channel + 1, 0xFF); // (This should have been done)
 			glStencilOp(GL_KEEP, GL_KEEP, GL_DECR_WRAP);
-			vb.render(); // Discard clip area
+			StreamingVertexBuffer::renderQuads(va); // Discard clip area
 			glStencilFunc(GL_EQUAL, channel, 0xFF);
 			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 		}
@@ -165,14 +196,14 @@ namespace GUI {
 	}
 
 	void Button::render(const Point2D& ul, const Point2D& lr, const Form&) const {
-		VertexArray va(120, VertexFormat(0, 4, 0, 3));
+		ColorVertexArray va(120);
 		// Border
-		va.setColor(4, mHover? ButtonColor1 : ButtonColor0);
+		va.setColor(mHover? ButtonColor1 : ButtonColor0);
 		drawQuad(va, ul.x, ul.y, lr.x, lr.y);
 		// Background quad
-		va.setColor(4, mPressed? ButtonColor1 : ButtonColor0);
+		va.setColor(mPressed? ButtonColor1 : ButtonColor0);
 		drawQuad(va, ul.x + LineWidth, ul.y + LineWidth, lr.x - LineWidth, lr.y - LineWidth);
-		VertexBuffer(va).render();
+		submitQuads(va, LayerBackground);
 		// Text
 		drawTextCentered(ul, lr, text, ButtonTextColor, mPressed ? ButtonColor1 : ButtonColor0);
 	}
@@ -202,20 +233,20 @@ namespace GUI {
 	void TrackBar::render(const Point2D& ul, const Point2D& lr, const Form&) const {
 		int hw = TrackBarWidth / 2, xmin = ul.x + hw, xmax = lr.x - hw;
 		int xsel = (value - lower) / (upper - lower) * (xmax - xmin) + xmin;
-		VertexArray va(120, VertexFormat(0, 4, 0, 3));
+		ColorVertexArray va(120);
 		// Background quad
-		va.setColor(4, mSelecting ? BackColor1 : (mHover ? BackColor0 : BackColor1));
+		va.setColor(mSelecting ? BackColor1 : (mHover ? BackColor0 : BackColor1));
 		drawQuad(va, ul.x, ul.y + LineWidth, lr.x, lr.y - LineWidth);
-		VertexBuffer(va).render();
+		submitQuads(va, LayerBackground);
 		// Text
 		drawTextCentered(ul, lr, text, TextColor, mSelecting ? BackColor1 : (mHover ? BackColor0 : BackColor1));
 		// Foreground Quad
 		va.clear();
-		va.setColor(4, (mButtonHover || mSelecting) ? ButtonColor1 : ButtonColor0);
+		va.setColor((mButtonHover || mSelecting) ? ButtonColor1 : ButtonColor0);
 		drawQuad(va, float(xsel - hw), ul.y, float(xsel + hw), lr.y);
-		va.setColor(4, mSelecting ? ButtonColor1 : ButtonColor0);
+		va.setColor(mSelecting ? ButtonColor1 : ButtonColor0);
 		drawQuad(va, float(xsel - hw) + LineWidth, ul.y + LineWidth, float(xsel + hw) - LineWidth, lr.y - LineWidth);
-		VertexBuffer(va).render();
+		submitQuads(va, LayerForeground);
 	}
 
 	void PictureBox::update(const Point2D& ul, const Point2D& lr, Form& form) {
@@ -226,28 +257,59 @@ namespace GUI {
 			if (form.mouseLeftPressed()) mPressed = true;
 			if (focused(form) && form.mouseLeftUp()) mClicked = true;
 		}
+		if (virtualPicture != nullptr) {
+			float bw = borderWidth * PictureBoxBorderWidth;
+			virtualPicture->update(uvRect, lr.x - ul.x - bw * 2.0f, lr.y - ul.y - bw * 2.0f);
+		}
 	}
 
 	void PictureBox::render(const Point2D& ul, const Point2D& lr, const Form&) const {
-		VertexArray va(120, VertexFormat(0, 4, 0, 3)), tva(120, VertexFormat(2, 4, 0, 3));
+		ColorVertexArray va(120);
+		PictureVertexArray tva(120);
 		// Background quad
-		va.setColor(4, mPressed? BackColor1 : (mHover? BackColor0 : BackColor1));
+		va.setColor(mPressed? BackColor1 : (mHover? BackColor0 : BackColor1));
 		drawQuad(va, ul.x, ul.y, lr.x, lr.y);
-		VertexBuffer(va).render();
+		submitQuads(va, LayerBackground);
 		// Picture
 		float bw = borderWidth * PictureBoxBorderWidth;
-		if (picture != nullptr) {
-			tva.setColor({ 1.0f, 1.0f, 1.0f, 1.0f });
-			tva.setTexture({ 0.0f, 0.0f }); tva.addVertex({ ul.x + bw, ul.y + bw });
-			tva.setTexture({ 0.0f, 1.0f }); tva.addVertex({ ul.x + bw, lr.y - bw });
-			tva.setTexture({ 1.0f, 0.0f }); tva.addVertex({ lr.x - bw, ul.y + bw });
-			tva.setTexture({ 0.0f, 1.0f }); tva.addVertex({ ul.x + bw, lr.y - bw });
-			tva.setTexture({ 1.0f, 1.0f }); tva.addVertex({ lr.x - bw, lr.y - bw });
-			tva.setTexture({ 1.0f, 0.0f }); tva.addVertex({ lr.x - bw, ul.y + bw });
-			Renderer::enableTexture2D();
-			picture->bind();
-			VertexBuffer(tva).render();
-			Renderer::disableTexture2D();
+		UVRect uv = uvRect;
+		const Texture* tex = picture;
+		if (atlas != nullptr && atlasRegion >= 0) tex = &atlas->texture(), uv = atlas->uvRect(atlasRegion);
+		else if (pictureHandle.valid()) {
+			// Size of the whole picture on screen, which decides the mip levels loaded (the box size for empty uv extents)
+			float width = lr.x - ul.x - bw * 2.0f, height = lr.y - ul.y - bw * 2.0f;
+			float du = std::abs(uv.u1 - uv.u0), dv = std::abs(uv.v1 - uv.v0);
+			if (du > 0.0f) width /= du;
+			if (dv > 0.0f) height /= dv;
+			tex = &pictureHandle.texture(width, height);
+		}
+		if (virtualPicture != nullptr) {
+			// One quad per tile, mapped from the visible part of the picture onto the box (none for empty uv extents)
+			std::vector<VirtualTexture::Quad> quads;
+			if (uv.u1 != uv.u0 && uv.v1 != uv.v0) virtualPicture->quads(uv, quads);
+			float x0 = ul.x + bw, y0 = ul.y + bw;
+			float sx = (lr.x - ul.x - bw * 2.0f) / (uv.u1 - uv.u0), sy = (lr.y - ul.y - bw * 2.0f) / (uv.v1 - uv.v0);
+			tva.setColor(1.0f, 1.0f, 1.0f, 1.0f);
+			for (const VirtualTexture::Quad& q: quads) {
+				PictureVertexArray::Vertex* v = tva.addQuad();
+				float qx0 = x0 + (q.image.u0 - uv.u0) * sx, qy0 = y0 + (q.image.v0 - uv.v0) * sy;
+				float qx1 = x0 + (q.image.u1 - uv.u0) * sx, qy1 = y0 + (q.image.v1 - uv.v0) * sy;
+				v[0].setTexture(q.cache.u0, q.cache.v0); v[0].setCoordinates(qx0, qy0);
+				v[1].setTexture(q.cache.u0, q.cache.v1); v[1].setCoordinates(qx0, qy1);
+				v[2].setTexture(q.cache.u1, q.cache.v0); v[2].setCoordinates(qx1, qy0);
+				v[3].setTexture(q.cache.u1, q.cache.v1); v[3].setCoordinates(qx1, qy1);
+			}
+			if (!quads.empty()) submitQuads(tva, LayerForeground, virtualPicture->texture().id());
+			tex = nullptr;
+		}
+		if (tex != nullptr) {
+			tva.setColor(1.0f, 1.0f, 1.0f, 1.0f);
+			PictureVertexArray::Vertex* v = tva.addQuad();
+			v[0].setTexture(uv.u0, uv.v0); v[0].setCoordinates(ul.x + bw, ul.y + bw);
+			v[1].setTexture(uv.u0, uv.v1); v[1].setCoordinates(ul.x + bw, lr.y - bw);
+			v[2].setTexture(uv.u1, uv.v0); v[2].setCoordinates(lr.x - bw, ul.y + bw);
+			v[3].setTexture(uv.u1, uv.v1); v[3].setCoordinates(lr.x - bw, lr.y - bw);
+			submitQuads(tva, LayerForeground, tex->id());
 		}
 	}
 	
@@ -307,55 +369,55 @@ namespace GUI {
 		Point2D ulleft = ul, lrleft = Point2D(ul.x + ScrollButtonSize, lr.y); // Left button
 		Point2D ulright = Point2D(lr.x - ScrollButtonSize, ul.y), lrright = lr; // Right button
 		// Render
-		VertexArray va(120, VertexFormat(0, 4, 0, 3));
+		ColorVertexArray va(120);
 		// Background quad
-		va.setColor(4, BackColor1);
+		va.setColor(BackColor1);
 		drawQuad(va, ul.x, ul.y, lr.x, lr.y);
 		// Border
-		va.setColor(4, (mHover || mSelecting)? ButtonColor1 : ButtonColor0);
+		va.setColor((mHover || mSelecting)? ButtonColor1 : ButtonColor0);
 		drawQuad(va, float(left), ul.y, float(left + len), lr.y);
 		// Foreground quad
-		va.setColor(4, mSelecting? ButtonColor1 : ButtonColor0);
+		va.setColor(mSelecting? ButtonColor1 : ButtonColor0);
 		drawQuad(va, float(left) + LineWidth, ul.y + LineWidth, float(left + len) - LineWidth, lr.y - LineWidth);
 		// Left Button
 		if (mLeftHover) {
-			va.setColor(4, BackColor1);
+			va.setColor(BackColor1);
 			drawQuad(va, ulleft.x, ulleft.y, lrleft.x, lrleft.y);
 		}
 		Point2D center = ((ulleft + lrleft) / 2.0f).round() + Point2D(0.0f, 0.0f);
-		va.setColor(4, mLeftPressed? ButtonColor1 : ButtonColor0);
-		va.addVertex({ center.x - 3, center.y + 1 });
-		va.addVertex({ center.x, center.y + 1 });
-		va.addVertex({ center.x + 4, center.y + 1 - 4 });
-		va.addVertex({ center.x - 3, center.y + 1 });
-		va.addVertex({ center.x + 4, center.y + 1 - 4 });
-		va.addVertex({ center.x - 3 + 4, center.y + 1 - 4 });
-		va.addVertex({ center.x, center.y });
-		va.addVertex({ center.x - 3, center.y });
-		va.addVertex({ center.x + 4, center.y + 4 });
-		va.addVertex({ center.x + 4, center.y + 4 });
-		va.addVertex({ center.x - 3, center.y });
-		va.addVertex({ center.x - 3 + 4, center.y + 4 });
+		va.setColor(mLeftPressed? ButtonColor1 : ButtonColor0);
+		va.addQuad(
+			va.vertex(center.x, center.y + 1),
+			va.vertex(center.x + 4, center.y + 1 - 4),
+			va.vertex(center.x - 3, center.y + 1),
+			va.vertex(center.x - 3 + 4, center.y + 1 - 4)
+		);
+		va.addQuad(
+			va.vertex(center.x, center.y),
+			va.vertex(center.x - 3, center.y),
+			va.vertex(center.x + 4, center.y + 4),
+			va.vertex(center.x - 3 + 4, center.y + 4)
+		);
 		// Right Button
 		if (mRightHover) {
-			va.setColor(4, BackColor1);
+			va.setColor(BackColor1);
 			drawQuad(va, ulright.x, ulright.y, lrright.x, lrright.y);
 		}
 		center = ((ulright + lrright) / 2.0f).round() + Point2D(1.0f, 0.0f);
-		va.setColor(4, mRightPressed? ButtonColor1 : ButtonColor0);
-		va.addVertex({ center.x, center.y + 1 });
-		va.addVertex({ center.x + 3, center.y + 1 });
-		va.addVertex({ center.x - 4, center.y + 1 - 4 });
-		va.addVertex({ center.x - 4, center.y + 1 - 4 });
-		va.addVertex({ center.x + 3, center.y + 1 });
-		va.addVertex({ center.x + 3 - 4, center.y + 1 - 4 });
-		va.addVertex({ center.x + 3, center.y });
-		va.addVertex({ center.x, center.y });
-		va.addVertex({ center.x - 4, center.y + 4 });
-		va.addVertex({ center.x + 3, center.y });
-		va.addVertex({ center.x - 4, center.y + 4 });
-		va.addVertex({ center.x + 3 - 4, center.y + 4 });
-		VertexBuffer(va).render();
+		va.setColor(mRightPressed? ButtonColor1 : ButtonColor0);
+		va.addQuad(
+			va.vertex(center.x, center.y + 1),
+			va.vertex(center.x + 3, center.y + 1),
+			va.vertex(center.x - 4, center.y + 1 - 4),
+			va.vertex(center.x + 3 - 4, center.y + 1 - 4)
+		);
+		va.addQuad(
+			va.vertex(center.x, center.y),
+			va.vertex(center.x - 4, center.y + 4),
+			va.vertex(center.x + 3, center.y),
+			va.vertex(center.x + 3 - 4, center.y + 4)
+		);
+		submitQuads(va, LayerBackground);
 	}
 	
 	void VScroll::update(const Point2D& ul, const Point2D& lr, Form& form) {
@@ -414,55 +476,55 @@ namespace GUI {
 		Point2D ulup = ul, lrup = Point2D(lr.x, ul.y + ScrollButtonSize); // Up button
 		Point2D uldown = Point2D(ul.x, lr.y - ScrollButtonSize), lrdown = lr; // Down button
 		// Render
-		VertexArray va(120, VertexFormat(0, 4, 0, 3));
+		ColorVertexArray va(120);
 		// Background quad
-		va.setColor(4, BackColor1);
+		va.setColor(BackColor1);
 		drawQuad(va, ul.x, ul.y, lr.x, lr.y);
 		// Border
-		va.setColor(4, (mHover || mSelecting)? ButtonColor1 : ButtonColor0);
+		va.setColor((mHover || mSelecting)? ButtonColor1 : ButtonColor0);
 		drawQuad(va, ul.x, float(up), lr.x, float(up + len));
 		// Foreground quad
-		va.setColor(4, mSelecting? ButtonColor1 : ButtonColor0);
+		va.setColor(mSelecting? ButtonColor1 : ButtonColor0);
 		drawQuad(va, ul.x + LineWidth, float(up) + LineWidth, lr.x - LineWidth, float(up + len) - LineWidth);
 		// Up Button
 		if (mUpHover) {
-			va.setColor(4, BackColor1);
+			va.setColor(BackColor1);
 			drawQuad(va, ulup.x, ulup.y, lrup.x, lrup.y);
 		}
 		Point2D center = ((ulup + lrup) / 2.0f).round() + Point2D(0.5f, -0.5f);
-		va.setColor(4, mUpPressed? ButtonColor1 : ButtonColor0);
-		va.addVertex({ center.x + 1, center.y });
-		va.addVertex({ center.x + 1, center.y - 3 });
-		va.addVertex({ center.x + 1 - 4, center.y + 4 });
-		va.addVertex({ center.x + 1 - 4, center.y + 4 });
-		va.addVertex({ center.x + 1, center.y - 3 });
-		va.addVertex({ center.x + 1 - 4, center.y - 3 + 4 });
-		va.addVertex({ center.x, center.y - 3 });
-		va.addVertex({ center.x, center.y });
-		va.addVertex({ center.x + 4, center.y + 4 });
-		va.addVertex({ center.x, center.y - 3 });
-		va.addVertex({ center.x + 4, center.y + 4 });
-		va.addVertex({ center.x + 4, center.y - 3 + 4 });
+		va.setColor(mUpPressed? ButtonColor1 : ButtonColor0);
+		va.addQuad(
+			va.vertex(center.x + 1, center.y),
+			va.vertex(center.x + 1, center.y - 3),
+			va.vertex(center.x + 1 - 4, center.y + 4),
+			va.vertex(center.x + 1 - 4, center.y - 3 + 4)
+		);
+		va.addQuad(
+			va.vertex(center.x, center.y),
+			va.vertex(center.x + 4, center.y + 4),
+			va.vertex(center.x, center.y - 3),
+			va.vertex(center.x + 4, center.y - 3 + 4)
+		);
 		// Down Button
 		if (mDownHover) {
-			va.setColor(4, BackColor1);
+			va.setColor(BackColor1);
 			drawQuad(va, uldown.x, uldown.y, lrdown.x, lrdown.y);
 		}
 		center = ((uldown + lrdown) / 2.0f).round() + Point2D(0.5f, 0.5f);
-		va.setColor(4, mDownPressed? ButtonColor1 : ButtonColor0);
-		va.addVertex({ center.x + 1, center.y + 3 });
-		va.addVertex({ center.x + 1, center.y });
-		va.addVertex({ center.x + 1 - 4, center.y - 4 });
-		va.addVertex({ center.x + 1, center.y + 3 });
-		va.addVertex({ center.x + 1 - 4, center.y - 4 });
-		va.addVertex({ center.x + 1 - 4, center.y + 3 - 4 });
-		va.addVertex({ center.x, center.y });
-		va.addVertex({ center.x, center.y + 3 });
-		va.addVertex({ center.x + 4, center.y - 4 });
-		va.addVertex({ center.x + 4, center.y - 4 });
-		va.addVertex({ center.x, center.y + 3 });
-		va.addVertex({ center.x + 4, center.y + 3 - 4 });
-		VertexBuffer(va).render();
+		va.setColor(mDownPressed? ButtonColor1 : ButtonColor0);
+		va.addQuad(
+			va.vertex(center.x + 1, center.y),
+			va.vertex(center.x + 1 - 4, center.y - 4),
+			va.vertex(center.x + 1, center.y + 3),
+			va.vertex(center.x + 1 - 4, center.y + 3 - 4)
+		);
+		va.addQuad(
+			va.vertex(center.x, center.y),
+			va.vertex(center.x, center.y + 3),
+			va.vertex(center.x + 4, center.y - 4),
+			va.vertex(center.x + 4, center.y + 3 - 4)
+		);
+		submitQuads(va, LayerBackground);
 	}
 	
 	ScrollArea::ScrollArea(const Position& ul, const Position& lr, const Point2D& size_, const Point2D& position_, bool draggable_, bool scalable_, bool focusable):
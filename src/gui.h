@@ -7,6 +7,9 @@
 #include <cmath>
 #include "window.h"
 #include "texture.h"
+#include "texturecache.h"
+#include "textureatlas.h"
+#include "virtualtexture.h"
 
 namespace GUI {
 	const float InfFloat = 1e10f;
@@ -72,14 +75,7 @@ namespace GUI {
 			}
 		}
 		// Render subtree
-		virtual void renderAll(const Point2D& parentPos, const Point2D& parentSize, const Form& form, unsigned int channel = 0) const {
-			Point2D ul = upperLeft.compute(parentSize) + parentPos;
-			Point2D lr = lowerRight.compute(parentSize) + parentPos;
-			if (active) {
-				render(ul, lr, form);
-				for (const Control* c: mChildren) c->renderAll(ul, lr - ul, form, channel);
-			}
-		}
+		virtual void renderAll(const Point2D& parentPos, const Point2D& parentSize, const Form& form, unsigned int channel = 0) const;
 
 	private:
 		std::vector<Control*> mChildren;
@@ -188,7 +184,22 @@ namespace GUI {
 		PictureBox() = default;
 		PictureBox(const Position& ul, const Position& lr, const Texture* picture_, bool focusable = true):
 			Control(ul, lr, focusable), picture(picture_) {}
+		// Shared picture, shown as a placeholder while (re)loading
+		PictureBox(const Position& ul, const Position& lr, const CachedTexture& picture_, bool focusable = true):
+			Control(ul, lr, focusable), pictureHandle(picture_) {}
+		// Picture packed into a texture atlas
+		PictureBox(const Position& ul, const Position& lr, const TextureAtlas& atlas_, int atlasRegion_, bool focusable = true):
+			Control(ul, lr, focusable), atlas(&atlas_), atlasRegion(atlasRegion_) {}
+		// Picture too large for a texture, tiles are paged in as uvRect pans & zooms
+		PictureBox(const Position& ul, const Position& lr, VirtualTexture& virtualPicture_, bool focusable = true):
+			Control(ul, lr, focusable), virtualPicture(&virtualPicture_) {}
 		const Texture* picture = nullptr;
+		CachedTexture pictureHandle;
+		const TextureAtlas* atlas = nullptr;
+		int atlasRegion = -1;
+		VirtualTexture* virtualPicture = nullptr;
+		// Part of the picture shown (overridden by the atlas region)
+		UVRect uvRect;
 		float borderWidth = 1.0f;
 
 		bool mouseHover() const { return mHover; }
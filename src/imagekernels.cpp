@@ -0,0 +1,502 @@
+#include "imagekernels.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <SDL2/SDL.h>
+#include "common.h"
+
+#ifdef PROJECTNAME_ARCH_X86
+#	include <immintrin.h>
+#	ifdef PROJECTNAME_COMPILER_MSVC
+#		define TARGET_SSE2
+#		define TARGET_AVX2
+#	else
+#		define TARGET_SSE2 __attribute__((target("sse2")))
+#		define TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#endif
+#ifdef PROJECTNAME_ARCH_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace {
+	// Scalar reference implementations
+
+	void rgbToRGBAScalar(const unsigned char* src, unsigned char* dst, int pixels) {
+		for (int i = 0; i < pixels; i++, src += 3, dst += 4) dst[0] = src[0], dst[1] = src[1], dst[2] = src[2], dst[3] = 255;
+	}
+
+	void rgbaToRGBScalar(const unsigned char* src, unsigned char* dst, int pixels) {
+		for (int i = 0; i < pixels; i++, src += 4, dst += 3) dst[0] = src[0], dst[1] = src[1], dst[2] = src[2];
+	}
+
+	void bgrToRGBScalar(const unsigned char* src, unsigned char* dst, int pixels) {
+		for (int i = 0; i < pixels; i++, src += 3, dst += 3) dst[0] = src[2], dst[1] = src[1], dst[2] = src[0];
+	}
+
+	void shrink2Scalar(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels, int bytesPerPixel) {
+		for (int i = 0; i < pixels; i++, row0 += bytesPerPixel * 2, row1 += bytesPerPixel * 2, dst += bytesPerPixel)
+			for (int k = 0; k < bytesPerPixel; k++)
+				dst[k] = static_cast<unsigned char>((row0[k] + row0[k + bytesPerPixel] + row1[k] + row1[k + bytesPerPixel]) >> 2);
+	}
+
+	void enlargeRowScalar(const unsigned char* src, unsigned char* dst, int pixels, int bytesPerPixel, int scale) {
+		for (int i = 0; i < pixels; i++, src += bytesPerPixel)
+			for (int j = 0; j < scale; j++, dst += bytesPerPixel)
+				for (int k = 0; k < bytesPerPixel; k++) dst[k] = src[k];
+	}
+
+	void fillScalar(unsigned char* dst, int pixels, int bytesPerPixel, const unsigned char* color) {
+		for (int i = 0; i < pixels; i++, dst += bytesPerPixel)
+			for (int k = 0; k < bytesPerPixel; k++) dst[k] = color[k];
+	}
+
+	// Fill by doubling already written pattern (any pixel size)
+	void fillPattern(unsigned char* dst, int pixels, int bytesPerPixel, const unsigned char* color) {
+		if (pixels == 0) return;
+		size_t bytes = size_t(pixels) * bytesPerPixel, filled = bytesPerPixel;
+		memcpy(dst, color, bytesPerPixel);
+		while (filled < bytes) {
+			size_t count = std::min(filled, bytes - filled);
+			memcpy(dst + filled, dst, count);
+			filled += count;
+		}
+	}
+
+	void accumulateScalar(const unsigned char* src, int* sums, int count, int weight) {
+		for (int i = 0; i < count; i++) sums[i] += src[i] * weight;
+	}
+
+	const ImageKernels::Table ScalarTable = { rgbToRGBAScalar, rgbaToRGBScalar, bgrToRGBScalar, shrink2Scalar, enlargeRowScalar, fillScalar, accumulateScalar };
+
+#ifdef PROJECTNAME_ARCH_X86
+	// SSE2 (x86 is little endian: a pixel loaded as 32 bits holds R in the lowest byte)
+
+	// 4 RGB pixels (12 bytes) into the low 3 bytes of 32-bit lanes, the top bytes are left undefined
+	TARGET_SSE2 __m128i loadRGB4(const unsigned char* src) {
+		int tail;
+		memcpy(&tail, src + 8, 4);
+		__m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)src), _mm_cvtsi32_si128(tail));
+		__m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+		__m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+		return _mm_unpacklo_epi64(p01, p23);
+	}
+
+	// Low 3 bytes of the 32-bit lanes as 4 RGB pixels (12 bytes): odd lanes are shifted down next to even ones,
+	// then the upper 64 bits next to the lower ones
+	TARGET_SSE2 void storeRGB4(__m128i v, unsigned char* dst) {
+		const __m128i even = _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF), odd = _mm_set_epi32(0xFFFFFF, 0, 0xFFFFFF, 0);
+		__m128i pairs = _mm_or_si128(_mm_and_si128(v, even), _mm_srli_epi64(_mm_and_si128(v, odd), 8));
+		__m128i res = _mm_or_si128(_mm_move_epi64(pairs), _mm_slli_si128(_mm_srli_si128(pairs, 8), 6));
+		_mm_storel_epi64((__m128i*)dst, res);
+		int tail = _mm_cvtsi128_si32(_mm_srli_si128(res, 8));
+		memcpy(dst + 8, &tail, 4);
+	}
+
+	TARGET_SSE2 void rgbToRGBASSE2(const unsigned char* src, unsigned char* dst, int pixels) {
+		const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+		int i = 0;
+		for (; i + 4 <= pixels; i += 4, src += 12, dst += 16) _mm_storeu_si128((__m128i*)dst, _mm_or_si128(loadRGB4(src), alpha));
+		rgbToRGBAScalar(src, dst, pixels - i);
+	}
+
+	TARGET_SSE2 void rgbaToRGBSSE2(const unsigned char* src, unsigned char* dst, int pixels) {
+		int i = 0;
+		for (; i + 4 <= pixels; i += 4, src += 16, dst += 12) storeRGB4(_mm_loadu_si128((const __m128i*)src), dst);
+		rgbaToRGBScalar(src, dst, pixels - i);
+	}
+
+	// Swap bytes 0 & 2 of the 32-bit lanes
+	TARGET_SSE2 void bgrToRGBSSE2(const unsigned char* src, unsigned char* dst, int pixels) {
+		const __m128i green = _mm_set1_epi32(0x0000FF00), low = _mm_set1_epi32(0x000000FF), high = _mm_set1_epi32(0x00FF0000);
+		int i = 0;
+		for (; i + 4 <= pixels; i += 4, src += 12, dst += 12) {
+			__m128i p = loadRGB4(src);
+			p = _mm_or_si128(_mm_or_si128(_mm_and_si128(p, green), _mm_and_si128(_mm_srli_epi32(p, 16), low)),
+							 _mm_and_si128(_mm_slli_epi32(p, 16), high));
+			storeRGB4(p, dst);
+		}
+		bgrToRGBScalar(src, dst, pixels - i);
+	}
+
+	TARGET_SSE2 __m128i shrink2x2RGBA(__m128i a, __m128i b) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+		return _mm_srli_epi16(sum, 2);
+	}
+
+	TARGET_SSE2 void shrink2RGBASSE2(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels) {
+		int i = 0;
+		for (; i + 4 <= pixels; i += 4, row0 += 32, row1 += 32, dst += 16) {
+			__m128i s0 = shrink2x2RGBA(_mm_loadu_si128((const __m128i*)row0), _mm_loadu_si128((const __m128i*)row1));
+			__m128i s1 = shrink2x2RGBA(_mm_loadu_si128((const __m128i*)(row0 + 16)), _mm_loadu_si128((const __m128i*)(row1 + 16)));
+			_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(s0, s1));
+		}
+		shrink2Scalar(row0, row1, dst, pixels - i, 4);
+	}
+
+	// RGB: vertical sums in 16 bits, horizontal sums of lanes 3 apart, then every other 3 bytes are kept
+	TARGET_SSE2 void shrink2RGBSSE2(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels) {
+		const int Chunk = 256;
+		alignas(16) uint16_t sums[Chunk * 6 + 8];
+		alignas(16) unsigned char averages[Chunk * 6 + 16];
+		const __m128i zero = _mm_setzero_si128();
+		while (pixels > 0) {
+			int count = std::min(pixels, Chunk), bytes = count * 6, i = 0;
+			for (; i + 16 <= bytes; i += 16) {
+				__m128i a = _mm_loadu_si128((const __m128i*)(row0 + i)), b = _mm_loadu_si128((const __m128i*)(row1 + i));
+				_mm_store_si128((__m128i*)(sums + i), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+				_mm_store_si128((__m128i*)(sums + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+			}
+			for (; i < bytes; i++) sums[i] = uint16_t(row0[i] + row1[i]);
+			int last = bytes - 3;
+			for (i = 0; i + 8 <= last; i += 8) {
+				__m128i s = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sums + i)), _mm_loadu_si128((const __m128i*)(sums + i + 3)));
+				s = _mm_srli_epi16(s, 2);
+				_mm_storel_epi64((__m128i*)(averages + i), _mm_packus_epi16(s, s));
+			}
+			for (; i < last; i++) averages[i] = static_cast<unsigned char>((sums[i] + sums[i + 3]) >> 2);
+			for (int j = 0; j < count; j++, dst += 3) dst[0] = averages[j * 6], dst[1] = averages[j * 6 + 1], dst[2] = averages[j * 6 + 2];
+			pixels -= count, row0 += bytes, row1 += bytes;
+		}
+	}
+
+	TARGET_SSE2 void shrink2SSE2(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels, int bytesPerPixel) {
+		if (bytesPerPixel == 4) shrink2RGBASSE2(row0, row1, dst, pixels);
+		else if (bytesPerPixel == 3) shrink2RGBSSE2(row0, row1, dst, pixels);
+		else shrink2Scalar(row0, row1, dst, pixels, bytesPerPixel);
+	}
+
+	TARGET_SSE2 void enlargeRowSSE2(const unsigned char* src, unsigned char* dst, int pixels, int bytesPerPixel, int scale) {
+		int i = 0;
+		if (bytesPerPixel == 3) {
+			// 4-byte copies, the extra byte is overwritten by the next one (last pixel copied separately)
+			for (; i + 1 < pixels; i++, src += 3) {
+				uint32_t p;
+				memcpy(&p, src, 4);
+				for (int j = 0; j < scale; j++, dst += 3) memcpy(dst, &p, 4);
+			}
+			enlargeRowScalar(src, dst, pixels - i, 3, scale);
+			return;
+		}
+		if (bytesPerPixel != 4) {
+			enlargeRowScalar(src, dst, pixels, bytesPerPixel, scale);
+			return;
+		}
+		if (scale == 2) {
+			for (; i + 4 <= pixels; i += 4, src += 16, dst += 32) {
+				__m128i p = _mm_loadu_si128((const __m128i*)src);
+				_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(p, p));
+				_mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi32(p, p));
+			}
+		} else if (scale >= 4) {
+			for (; i < pixels; i++, src += 4) {
+				uint32_t p;
+				memcpy(&p, src, 4);
+				__m128i v = _mm_set1_epi32(int(p));
+				int j = 0;
+				for (; j + 4 <= scale; j += 4, dst += 16) _mm_storeu_si128((__m128i*)dst, v);
+				for (; j < scale; j++, dst += 4) memcpy(dst, &p, 4);
+			}
+		}
+		enlargeRowScalar(src, dst, pixels - i, 4, scale);
+	}
+
+	TARGET_SSE2 void fillSSE2(unsigned char* dst, int pixels, int bytesPerPixel, const unsigned char* color) {
+		if (bytesPerPixel != 4) {
+			fillPattern(dst, pixels, bytesPerPixel, color);
+			return;
+		}
+		uint32_t p;
+		memcpy(&p, color, 4);
+		__m128i v = _mm_set1_epi32(int(p));
+		int i = 0;
+		for (; i + 4 <= pixels; i += 4, dst += 16) _mm_storeu_si128((__m128i*)dst, v);
+		fillScalar(dst, pixels - i, 4, color);
+	}
+
+	// 16-bit multiplies, low and high halves interleaved into 32-bit products
+	TARGET_SSE2 void accumulateSSE2(const unsigned char* src, int* sums, int count, int weight) {
+		const __m128i zero = _mm_setzero_si128(), w = _mm_set1_epi16(short(weight));
+		int i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+			__m128i halves[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+			for (int j = 0; j < 2; j++) {
+				__m128i lo = _mm_mullo_epi16(halves[j], w), hi = _mm_mulhi_epi16(halves[j], w);
+				__m128i* dst = (__m128i*)(sums + i + j * 8);
+				_mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), _mm_unpacklo_epi16(lo, hi)));
+				_mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), _mm_unpackhi_epi16(lo, hi)));
+			}
+		}
+		accumulateScalar(src + i, sums + i, count - i, weight);
+	}
+
+	const ImageKernels::Table SSE2Table = { rgbToRGBASSE2, rgbaToRGBSSE2, bgrToRGBSSE2, shrink2SSE2, enlargeRowSSE2, fillSSE2, accumulateSSE2 };
+
+	// AVX2 (byte shuffles within 128-bit lanes)
+
+	TARGET_AVX2 void rgbToRGBAAVX2(const unsigned char* src, unsigned char* dst, int pixels) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i alpha = _mm256_set1_epi32(int(0xFF000000u));
+		int i = 0;
+		// 16-byte loads of 12-byte groups read 4 bytes past the last pixel
+		for (; i + 10 <= pixels; i += 8, src += 24, dst += 32) {
+			__m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+												_mm_loadu_si128((const __m128i*)(src + 12)), 1);
+			_mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(_mm256_shuffle_epi8(p, shuffle), alpha));
+		}
+		rgbToRGBASSE2(src, dst, pixels - i);
+	}
+
+	TARGET_AVX2 void rgbaToRGBAVX2(const unsigned char* src, unsigned char* dst, int pixels) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+			0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		int i = 0;
+		// 16-byte stores of 12-byte groups write 4 bytes past the last pixel, overwritten by the next iteration
+		for (; i + 10 <= pixels; i += 8, src += 32, dst += 24) {
+			__m256i p = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), shuffle);
+			_mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(p));
+			_mm_storeu_si128((__m128i*)(dst + 12), _mm256_extracti128_si256(p, 1));
+		}
+		rgbaToRGBSSE2(src, dst, pixels - i);
+	}
+
+	TARGET_AVX2 void bgrToRGBAVX2(const unsigned char* src, unsigned char* dst, int pixels) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1,
+			2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+		int i = 0;
+		// 12-byte groups in 16-byte loads & stores, the 4 extra bytes stored are overwritten by the next iteration
+		for (; i + 10 <= pixels; i += 8, src += 24, dst += 24) {
+			__m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+												_mm_loadu_si128((const __m128i*)(src + 12)), 1);
+			p = _mm256_shuffle_epi8(p, shuffle);
+			_mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(p));
+			_mm_storeu_si128((__m128i*)(dst + 12), _mm256_extracti128_si256(p, 1));
+		}
+		bgrToRGBSSE2(src, dst, pixels - i);
+	}
+
+	TARGET_AVX2 __m256i shrink2x2RGBAAVX2(__m256i a, __m256i b) {
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+		__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+		__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+		return _mm256_srli_epi16(sum, 2);
+	}
+
+	TARGET_AVX2 void shrink2AVX2(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels, int bytesPerPixel) {
+		if (bytesPerPixel != 4) {
+			shrink2SSE2(row0, row1, dst, pixels, bytesPerPixel);
+			return;
+		}
+		int i = 0;
+		for (; i + 8 <= pixels; i += 8, row0 += 64, row1 += 64, dst += 32) {
+			__m256i s0 = shrink2x2RGBAAVX2(_mm256_loadu_si256((const __m256i*)row0), _mm256_loadu_si256((const __m256i*)row1));
+			__m256i s1 = shrink2x2RGBAAVX2(_mm256_loadu_si256((const __m256i*)(row0 + 32)), _mm256_loadu_si256((const __m256i*)(row1 + 32)));
+			// Lanes hold pixels [0 1 4 5 | 2 3 6 7] of each half after packing
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8);
+			_mm256_storeu_si256((__m256i*)dst, packed);
+		}
+		shrink2RGBASSE2(row0, row1, dst, pixels - i);
+	}
+
+	TARGET_AVX2 void enlargeRowAVX2(const unsigned char* src, unsigned char* dst, int pixels, int bytesPerPixel, int scale) {
+		if (bytesPerPixel != 4 || scale != 2) {
+			enlargeRowSSE2(src, dst, pixels, bytesPerPixel, scale);
+			return;
+		}
+		int i = 0;
+		for (; i + 8 <= pixels; i += 8, src += 32, dst += 64) {
+			__m256i p = _mm256_loadu_si256((const __m256i*)src);
+			__m256i lo = _mm256_unpacklo_epi32(p, p), hi = _mm256_unpackhi_epi32(p, p);
+			_mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+		enlargeRowSSE2(src, dst, pixels - i, 4, 2);
+	}
+
+	TARGET_AVX2 void fillAVX2(unsigned char* dst, int pixels, int bytesPerPixel, const unsigned char* color) {
+		if (bytesPerPixel != 4) {
+			fillPattern(dst, pixels, bytesPerPixel, color);
+			return;
+		}
+		uint32_t p;
+		memcpy(&p, color, 4);
+		__m256i v = _mm256_set1_epi32(int(p));
+		int i = 0;
+		for (; i + 8 <= pixels; i += 8, dst += 32) _mm256_storeu_si256((__m256i*)dst, v);
+		fillSSE2(dst, pixels - i, 4, color);
+	}
+
+	TARGET_AVX2 void accumulateAVX2(const unsigned char* src, int* sums, int count, int weight) {
+		const __m256i w = _mm256_set1_epi32(weight);
+		int i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m256i p0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+			__m256i p1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+			__m256i* dst = (__m256i*)(sums + i);
+			_mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), _mm256_mullo_epi32(p0, w)));
+			_mm256_storeu_si256(dst + 1, _mm256_add_epi32(_mm256_loadu_si256(dst + 1), _mm256_mullo_epi32(p1, w)));
+		}
+		accumulateSSE2(src + i, sums + i, count - i, weight);
+	}
+
+	const ImageKernels::Table AVX2Table = { rgbToRGBAAVX2, rgbaToRGBAVX2, bgrToRGBAVX2, shrink2AVX2, enlargeRowAVX2, fillAVX2, accumulateAVX2 };
+#endif
+
+#ifdef PROJECTNAME_ARCH_NEON
+	// NEON (structured loads/stores split channels into separate registers)
+
+	void rgbToRGBANEON(const unsigned char* src, unsigned char* dst, int pixels) {
+		int i = 0;
+		for (; i + 16 <= pixels; i += 16, src += 48, dst += 64) {
+			uint8x16x3_t p = vld3q_u8(src);
+			uint8x16x4_t res = { { p.val[0], p.val[1], p.val[2], vdupq_n_u8(255) } };
+			vst4q_u8(dst, res);
+		}
+		rgbToRGBAScalar(src, dst, pixels - i);
+	}
+
+	void rgbaToRGBNEON(const unsigned char* src, unsigned char* dst, int pixels) {
+		int i = 0;
+		for (; i + 16 <= pixels; i += 16, src += 64, dst += 48) {
+			uint8x16x4_t p = vld4q_u8(src);
+			uint8x16x3_t res = { { p.val[0], p.val[1], p.val[2] } };
+			vst3q_u8(dst, res);
+		}
+		rgbaToRGBScalar(src, dst, pixels - i);
+	}
+
+	void bgrToRGBNEON(const unsigned char* src, unsigned char* dst, int pixels) {
+		int i = 0;
+		for (; i + 16 <= pixels; i += 16, src += 48, dst += 48) {
+			uint8x16x3_t p = vld3q_u8(src);
+			uint8x16x3_t res = { { p.val[2], p.val[1], p.val[0] } };
+			vst3q_u8(dst, res);
+		}
+		bgrToRGBScalar(src, dst, pixels - i);
+	}
+
+	inline uint8x8_t shrink2x2NEON(uint8x16_t a, uint8x16_t b) {
+		return vshrn_n_u16(vaddq_u16(vpaddlq_u8(a), vpaddlq_u8(b)), 2);
+	}
+
+	void shrink2NEON(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels, int bytesPerPixel) {
+		int i = 0;
+		if (bytesPerPixel == 4) {
+			for (; i + 8 <= pixels; i += 8, row0 += 64, row1 += 64, dst += 32) {
+				uint8x16x4_t a = vld4q_u8(row0), b = vld4q_u8(row1);
+				uint8x8x4_t res;
+				for (int k = 0; k < 4; k++) res.val[k] = shrink2x2NEON(a.val[k], b.val[k]);
+				vst4_u8(dst, res);
+			}
+		} else if (bytesPerPixel == 3) {
+			for (; i + 8 <= pixels; i += 8, row0 += 48, row1 += 48, dst += 24) {
+				uint8x16x3_t a = vld3q_u8(row0), b = vld3q_u8(row1);
+				uint8x8x3_t res;
+				for (int k = 0; k < 3; k++) res.val[k] = shrink2x2NEON(a.val[k], b.val[k]);
+				vst3_u8(dst, res);
+			}
+		}
+		shrink2Scalar(row0, row1, dst, pixels - i, bytesPerPixel);
+	}
+
+	void enlargeRowNEON(const unsigned char* src, unsigned char* dst, int pixels, int bytesPerPixel, int scale) {
+		int i = 0;
+		if (scale == 2 && bytesPerPixel == 4) {
+			for (; i + 4 <= pixels; i += 4, src += 16, dst += 32) {
+				uint32x4_t p = vreinterpretq_u32_u8(vld1q_u8(src));
+				uint32x4x2_t res = vzipq_u32(p, p);
+				vst1q_u8(dst, vreinterpretq_u8_u32(res.val[0]));
+				vst1q_u8(dst + 16, vreinterpretq_u8_u32(res.val[1]));
+			}
+		} else if (scale == 2 && bytesPerPixel == 3) {
+			for (; i + 16 <= pixels; i += 16, src += 48, dst += 96) {
+				uint8x16x3_t p = vld3q_u8(src), lo, hi;
+				for (int k = 0; k < 3; k++) {
+					uint8x16x2_t z = vzipq_u8(p.val[k], p.val[k]);
+					lo.val[k] = z.val[0], hi.val[k] = z.val[1];
+				}
+				vst3q_u8(dst, lo);
+				vst3q_u8(dst + 48, hi);
+			}
+		}
+		enlargeRowScalar(src, dst, pixels - i, bytesPerPixel, scale);
+	}
+
+	void fillNEON(unsigned char* dst, int pixels, int bytesPerPixel, const unsigned char* color) {
+		int i = 0;
+		if (bytesPerPixel == 4) {
+			uint8x16x4_t v = { { vdupq_n_u8(color[0]), vdupq_n_u8(color[1]), vdupq_n_u8(color[2]), vdupq_n_u8(color[3]) } };
+			for (; i + 16 <= pixels; i += 16, dst += 64) vst4q_u8(dst, v);
+		} else if (bytesPerPixel == 3) {
+			uint8x16x3_t v = { { vdupq_n_u8(color[0]), vdupq_n_u8(color[1]), vdupq_n_u8(color[2]) } };
+			for (; i + 16 <= pixels; i += 16, dst += 48) vst3q_u8(dst, v);
+		}
+		fillScalar(dst, pixels - i, bytesPerPixel, color);
+	}
+
+	void accumulateNEON(const unsigned char* src, int* sums, int count, int weight) {
+		int16x4_t w = vdup_n_s16(int16_t(weight));
+		int i = 0;
+		for (; i + 8 <= count; i += 8) {
+			int16x8_t p = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(src + i)));
+			vst1q_s32(sums + i, vmlal_s16(vld1q_s32(sums + i), vget_low_s16(p), w));
+			vst1q_s32(sums + i + 4, vmlal_s16(vld1q_s32(sums + i + 4), vget_high_s16(p), w));
+		}
+		accumulateScalar(src + i, sums + i, count - i, weight);
+	}
+
+	const ImageKernels::Table NEONTable = { rgbToRGBANEON, rgbaToRGBNEON, bgrToRGBNEON, shrink2NEON, enlargeRowNEON, fillNEON, accumulateNEON };
+#endif
+
+	const ImageKernels::Table* table(ImageKernels::Level level) {
+		switch (level) {
+#ifdef PROJECTNAME_ARCH_X86
+		case ImageKernels::LevelSSE2: return &SSE2Table;
+		case ImageKernels::LevelAVX2: return &AVX2Table;
+#endif
+#ifdef PROJECTNAME_ARCH_NEON
+		case ImageKernels::LevelNEON: return &NEONTable;
+#endif
+		default: return &ScalarTable;
+		}
+	}
+}
+
+std::atomic<ImageKernels::Level> ImageKernels::mLevel(ImageKernels::supportedLevel());
+std::atomic<const ImageKernels::Table*> ImageKernels::mTable(table(ImageKernels::supportedLevel()));
+
+ImageKernels::Level ImageKernels::supportedLevel() {
+#if defined PROJECTNAME_ARCH_X86
+	if (SDL_HasAVX2()) return LevelAVX2;
+	if (SDL_HasSSE2()) return LevelSSE2;
+#elif defined PROJECTNAME_ARCH_NEON
+	return LevelNEON;
+#endif
+	return LevelScalar;
+}
+
+void ImageKernels::setLevel(Level level) {
+	Level supported = supportedLevel();
+	bool available = level == LevelScalar || level == supported || (level == LevelSSE2 && supported == LevelAVX2);
+	if (!available) level = supported;
+	mLevel.store(level, std::memory_order_relaxed);
+	mTable.store(table(level), std::memory_order_relaxed);
+}
+
+const char* ImageKernels::levelName(Level level) {
+	switch (level) {
+	case LevelSSE2: return "SSE2";
+	case LevelAVX2: return "AVX2";
+	case LevelNEON: return "NEON";
+	default: return "scalar";
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef IMAGEKERNELS_H_
+#define IMAGEKERNELS_H_
+
+#include <atomic>
+
+// Row kernels for 8-bit RGB/RGBA images, selected at runtime by CPU features.
+// All implementations produce bit-identical output.
+class ImageKernels {
+public:
+	enum Level { LevelScalar, LevelSSE2, LevelAVX2, LevelNEON };
+
+	// Currently used implementation
+	static Level level() { return mLevel.load(std::memory_order_relaxed); }
+	// Best implementation supported by the CPU
+	static Level supportedLevel();
+	// Switch implementation (clamped to supported ones). Safe while other threads run kernels, which use either one
+	static void setLevel(Level level);
+	static const char* levelName(Level level);
+
+	// RGB -> RGBA (alpha = 255)
+	static void rgbToRGBA(const unsigned char* src, unsigned char* dst, int pixels) { kernels().rgbToRGBA(src, dst, pixels); }
+	// RGBA -> RGB
+	static void rgbaToRGB(const unsigned char* src, unsigned char* dst, int pixels) { kernels().rgbaToRGB(src, dst, pixels); }
+	// BGR <-> RGB (source & destination must not overlap)
+	static void bgrToRGB(const unsigned char* src, unsigned char* dst, int pixels) { kernels().bgrToRGB(src, dst, pixels); }
+	// 2x2 box filter: `pixels` destination pixels from two source rows of 2 * `pixels` pixels
+	static void shrink2(const unsigned char* row0, const unsigned char* row1, unsigned char* dst, int pixels, int bytesPerPixel) {
+		kernels().shrink2(row0, row1, dst, pixels, bytesPerPixel);
+	}
+	// Nearest upscaling of a row: each source pixel repeated `scale` times
+	static void enlargeRow(const unsigned char* src, unsigned char* dst, int pixels, int bytesPerPixel, int scale) {
+		kernels().enlargeRow(src, dst, pixels, bytesPerPixel, scale);
+	}
+	// Fill `pixels` pixels with a solid color
+	static void fill(unsigned char* dst, int pixels, int bytesPerPixel, const unsigned char* color) {
+		kernels().fill(dst, pixels, bytesPerPixel, color);
+	}
+	// sums[i] += src[i] * weight (weight must fit in 16 bits)
+	static void accumulate(const unsigned char* src, int* sums, int count, int weight) {
+		kernels().accumulate(src, sums, count, weight);
+	}
+
+	struct Table {
+		void (*rgbToRGBA)(const unsigned char*, unsigned char*, int);
+		void (*rgbaToRGB)(const unsigned char*, unsigned char*, int);
+		void (*bgrToRGB)(const unsigned char*, unsigned char*, int);
+		void (*shrink2)(const unsigned char*, const unsigned char*, unsigned char*, int, int);
+		void (*enlargeRow)(const unsigned char*, unsigned char*, int, int, int);
+		void (*fill)(unsigned char*, int, int, const unsigned char*);
+		void (*accumulate)(const unsigned char*, int*, int, int);
+	};
+
+private:
+	// Tables are constants, so relaxed loads see them complete
+	static std::atomic<Level> mLevel;
+	static std::atomic<const Table*> mTable;
+
+	static const Table& kernels() { return *mTable.load(std::memory_order_relaxed); }
+};
+
+#endif // !IMAGEKERNELS_H_
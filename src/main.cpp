@@ -1,15 +1,23 @@
 #include <stdlib.h>
 #include <memory>
+#include <cstring>
+#include <algorithm>
 #include "config.h"
 #include "window.h"
 #include "renderer.h"
 #include "vertexarray.h"
+#include "framearena.h"
 #include "camera.h"
 #include "framebuffer.h"
 #include "updatescheduler.h"
 #include "bitmap.h"
 #include "textrenderer.h"
 #include "gui.h"
+#include "benchmark.h"
+#include "threadpool.h"
+#include "texturecontainer.h"
+#include "virtualtexture.h"
+#include "screenshot.h"
 
 // TODO: multiple contexts & multithreading (MakeCurrent is really slow!)
 class Dialog {
@@ -72,9 +80,25 @@ public:
 	}
 };
 
-int main() {
+int main(int argc, char* argv[]) {
 	// Initialize
 	Config::load();
+	ThreadPool::init();
+	
+	// Texture cooking: --cook <image> <output> [<image> <output>...], output extension selects the format
+	if (argc >= 2 && std::string(argv[1]) == "--cook") {
+		bool success = argc >= 4 && argc % 2 == 0;
+		if (!success) LogError("Usage: --cook <image> <output" + std::string(TextureContainer::Extension) + "|" + VirtualTexture::Extension + "> ...");
+		else for (int i = 2; i < argc; i += 2) {
+			// Tile pyramids for images too large for one texture
+			std::string output = argv[i + 1];
+			size_t ext = output.size() - std::min(output.size(), std::strlen(VirtualTexture::Extension));
+			if (output.compare(ext, std::string::npos, VirtualTexture::Extension) == 0) success = VirtualTexture::cook(argv[i], output) && success;
+			else success = TextureContainer::cook(argv[i], output) && success;
+		}
+		ThreadPool::destroy();
+		return success ? 0 : 1;
+	}
 	Window::init();
 	
 	// Get scaling factor
@@ -87,11 +111,15 @@ int main() {
 	// Init renderer & text renderer
 	Renderer::init();
 	TextRenderer::init();
+	TextureLoader::init();
+	TextureCache::init();
+	Screenshot::init();
+	
+	// Performance measurements
+	if (Config::getInt("Benchmark.Run", 0) != 0) Benchmark::run();
 	
 	// Create GUI
-	TextureImage image("./Data/Test.png");
-	image = image.resample(2048, 2048);
-	Texture* ptex = new Texture(image, true);
+	CachedTexture ptex = TextureCache::load("./Data/Test.png", true, true, -1, 2048, 2048);
 	
 	using GUI::Position;
 	using GUI::Point2D;
@@ -137,11 +165,20 @@ int main() {
 	// Main Loop
 
 	while (!win.shouldQuit()) {
+		// Release transient geometry of the previous frame
+		FrameArena::reset();
+		
 		win.makeCurrent();
 		Renderer::waitForComplete();
 		Renderer::checkError();
 		win.swapBuffers();
 		
+		// Time-sliced texture uploads
+		TextureLoader::update();
+		TextureCache::update();
+		// Write screenshots read back in previous frames
+		Screenshot::update();
+		
 		Renderer::setRenderArea(0, 0, win.getWidth(), win.getHeight());
 		Renderer::beginFinalPass();
 		
@@ -178,6 +215,9 @@ int main() {
 
 		Renderer::endFinalPass();
 		
+		// Capture the finished frame (F12), written in the background
+		if (win.isKeyActed(SDL_SCANCODE_F12)) Screenshot::capture(win.getWidth(), win.getHeight());
+		
 		// Render dialog windows
 		for (auto& dialog: dialogs) dialog->render();
 		
@@ -215,6 +255,11 @@ int main() {
 		if (Window::isKeyPressed(SDL_SCANCODE_ESCAPE)) break;
 	}
 
+	Screenshot::destroy();
+	TextureCache::destroy();
+	TextureLoader::destroy();
+	Renderer::destroy();
+	ThreadPool::destroy();
 	Config::save();
 	return 0;
 }
@@ -0,0 +1,61 @@
+#include "mappedfile.h"
+#ifdef PROJECTNAME_TARGET_WINDOWS
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string& filename, bool sequential) {
+	close();
+#ifdef PROJECTNAME_TARGET_WINDOWS
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+							  sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+	mFile = file, mMapping = mapping;
+	mSize = size_t(size.QuadPart);
+	mData = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if (file < 0) return false;
+	struct stat info;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		void* mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapped != MAP_FAILED) {
+			mData = static_cast<const unsigned char*>(mapped);
+			mSize = size_t(info.st_size);
+			if (sequential) madvise(mapped, mSize, MADV_SEQUENTIAL);
+		}
+	}
+	// The mapping stays valid without the descriptor
+	::close(file);
+#endif
+	if (mData == nullptr) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef PROJECTNAME_TARGET_WINDOWS
+	if (mData != nullptr) UnmapViewOfFile(mData);
+	if (mMapping != nullptr) CloseHandle(mMapping);
+	if (mFile != nullptr) CloseHandle(mFile);
+	mFile = mMapping = nullptr;
+#else
+	if (mData != nullptr) munmap(const_cast<unsigned char*>(mData), mSize);
+#endif
+	mData = nullptr;
+	mSize = 0;
+}
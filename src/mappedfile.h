@@ -0,0 +1,33 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <string>
+#include "common.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Map file, `sequential` hints that it will be read front to back once
+	bool open(const std::string& filename, bool sequential = true);
+	void close();
+
+	bool empty() const { return mData == nullptr; }
+	const unsigned char* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+private:
+	const unsigned char* mData = nullptr;
+	size_t mSize = 0;
+#ifdef PROJECTNAME_TARGET_WINDOWS
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#endif
+};
+
+#endif // !MAPPEDFILE_H_
@@ -0,0 +1,171 @@
+#include "meshoptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include "logger.h"
+
+MeshOptimizer::Mesh MeshOptimizer::optimize(const VertexFormat& format, const void* data, int vertexes) {
+	Mesh res;
+	Assert(vertexes % 3 == 0, "Mesh is not a triangle list");
+	res.vertexCount = deduplicate(format, data, vertexes, res.vertices, res.indexes);
+	float before = acmr(res.indexes.data(), int(res.indexes.size()));
+	optimizeVertexCache(res.indexes, res.vertexCount);
+	optimizeVertexFetch(format.vertexSize(), res.vertices, res.indexes);
+	float after = acmr(res.indexes.data(), int(res.indexes.size()));
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3) << "Mesh optimizer: " << vertexes << " -> " << res.vertexCount
+	   << " vertexes, ACMR 3.000 (non-indexed) / " << before << " (indexed) -> " << after;
+	LogVerbose(ss.str());
+	return res;
+}
+
+float MeshOptimizer::acmr(const unsigned int* indexes, int count, int cacheSize) {
+	if (count < 3) return 0.0f;
+	std::vector<unsigned int> cache(cacheSize);
+	int cached = 0, head = 0, misses = 0;
+	for (int i = 0; i < count; i++) {
+		bool hit = false;
+		for (int j = 0; j < cached && !hit; j++) hit = cache[j] == indexes[i];
+		if (hit) continue;
+		misses++;
+		// FIFO replacement
+		cache[head] = indexes[i];
+		head = (head + 1) % cacheSize;
+		cached = std::min(cached + 1, cacheSize);
+	}
+	return float(misses) / float(count / 3);
+}
+
+int MeshOptimizer::deduplicate(const VertexFormat& format, const void* data, int vertexes,
+							   std::vector<unsigned char>& vertices, std::vector<unsigned int>& indexes) {
+	const unsigned char* src = static_cast<const unsigned char*>(data);
+	size_t stride = format.vertexSize();
+	vertices.clear();
+	vertices.reserve(vertexes * stride);
+	indexes.resize(vertexes);
+
+	// Open addressing hash table of unique vertex indexes
+	size_t tableSize = 1;
+	while (tableSize < size_t(vertexes) * 2) tableSize *= 2;
+	std::vector<int> table(tableSize, -1);
+	int unique = 0;
+	for (int i = 0; i < vertexes; i++) {
+		const unsigned char* v = src + i * stride;
+		unsigned int hash = 2166136261u; // FNV-1a
+		for (size_t j = 0; j < stride; j++) hash = (hash ^ v[j]) * 16777619u;
+		size_t slot = hash & (tableSize - 1);
+		while (table[slot] != -1 && memcmp(vertices.data() + table[slot] * stride, v, stride) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot] == -1) {
+			table[slot] = unique++;
+			vertices.insert(vertices.end(), v, v + stride);
+		}
+		indexes[i] = unsigned(table[slot]);
+	}
+	return unique;
+}
+
+namespace {
+	// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+	constexpr int CacheSize = 32;
+	constexpr float CacheDecayPower = 1.5f, LastTriangleScore = 0.75f;
+	constexpr float ValenceBoostScale = 2.0f, ValenceBoostPower = 0.5f;
+
+	float vertexScore(int cachePosition, int remainingTriangles) {
+		if (remainingTriangles == 0) return -1.0f;
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			// Vertexes of the last triangle get a fixed score, so that the next one does not simply reuse its edges
+			if (cachePosition < 3) score = LastTriangleScore;
+			else score = std::pow(1.0f - float(cachePosition - 3) / float(CacheSize - 3), CacheDecayPower);
+		}
+		// Favor vertexes with few triangles left, to avoid leaving lone triangles behind
+		return score + ValenceBoostScale * std::pow(float(remainingTriangles), -ValenceBoostPower);
+	}
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indexes, int vertexCount) {
+	int triangles = int(indexes.size() / 3);
+	if (triangles == 0) return;
+
+	// Triangles adjacent to each vertex
+	std::vector<int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0), adjacency(indexes.size());
+	for (unsigned int v: indexes) remaining[v]++;
+	for (int i = 0; i < vertexCount; i++) offsets[i + 1] = offsets[i] + remaining[i];
+	std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+	for (int t = 0; t < triangles; t++) for (int k = 0; k < 3; k++) adjacency[fill[indexes[t * 3 + k]]++] = t;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount), triangleScore(triangles, 0.0f);
+	std::vector<char> added(triangles, 0);
+	for (int i = 0; i < vertexCount; i++) score[i] = vertexScore(-1, remaining[i]);
+	for (int t = 0; t < triangles; t++) for (int k = 0; k < 3; k++) triangleScore[t] += score[indexes[t * 3 + k]];
+
+	int best = int(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+	std::vector<unsigned int> result;
+	result.reserve(indexes.size());
+	std::vector<int> cache, next;
+	cache.reserve(CacheSize + 3), next.reserve(CacheSize + 3);
+	int cursor = 0;
+
+	while (best >= 0) {
+		added[best] = 1;
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = indexes[best * 3 + k];
+			result.push_back(v);
+			// Remove triangle from vertex adjacency
+			int* begin = &adjacency[offsets[v]];
+			int* end = begin + remaining[v];
+			*std::find(begin, end, best) = *(end - 1);
+			remaining[v]--;
+		}
+
+		// Move triangle vertexes to the front of the LRU cache
+		next.clear();
+		for (int k = 0; k < 3; k++) next.push_back(int(indexes[best * 3 + k]));
+		for (int v: cache) if (std::find(next.begin(), next.begin() + 3, v) == next.begin() + 3) next.push_back(v);
+		for (size_t i = 0; i < next.size(); i++) cachePosition[next[i]] = i < size_t(CacheSize) ? int(i) : -1;
+
+		// Update scores of vertexes in (or just evicted from) the cache, find best adjacent triangle
+		best = -1;
+		float bestScore = -1.0f;
+		for (int v: next) {
+			float newScore = vertexScore(cachePosition[v], remaining[v]), delta = newScore - score[v];
+			score[v] = newScore;
+			for (int i = offsets[v]; i < offsets[v] + remaining[v]; i++) {
+				int t = adjacency[i];
+				triangleScore[t] += delta;
+				if (triangleScore[t] > bestScore) best = t, bestScore = triangleScore[t];
+			}
+		}
+		if (next.size() > size_t(CacheSize)) next.resize(CacheSize);
+		cache.swap(next);
+
+		// Nothing adjacent: continue with any remaining triangle
+		if (best < 0) {
+			while (cursor < triangles && added[cursor]) cursor++;
+			if (cursor < triangles) best = cursor;
+		}
+	}
+	indexes.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(int vertexSize, std::vector<unsigned char>& vertices, std::vector<unsigned int>& indexes) {
+	size_t vertexCount = vertices.size() / vertexSize;
+	std::vector<int> remap(vertexCount, -1);
+	std::vector<unsigned char> result(vertices.size());
+	int count = 0;
+	for (unsigned int& index: indexes) {
+		if (remap[index] < 0) {
+			remap[index] = count;
+			memcpy(result.data() + size_t(count) * vertexSize, vertices.data() + size_t(index) * vertexSize, vertexSize);
+			count++;
+		}
+		index = unsigned(remap[index]);
+	}
+	result.resize(size_t(count) * vertexSize);
+	vertices.swap(result);
+}
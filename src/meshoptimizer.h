@@ -0,0 +1,38 @@
+#ifndef MESHOPTIMIZER_H_
+#define MESHOPTIMIZER_H_
+
+#include <vector>
+#include "vertexarray.h"
+
+// Load-time optimization of static triangle meshes:
+// vertex deduplication into an index buffer, triangle order for post-transform vertex cache (Forsyth),
+// vertex order for fetch locality.
+class MeshOptimizer {
+public:
+	struct Mesh {
+		// Unique vertexes, in the vertex format of the source
+		std::vector<unsigned char> vertices;
+		int vertexCount = 0;
+		// Triangle indexes
+		std::vector<unsigned int> indexes;
+	};
+
+	// Optimize triangle list
+	static Mesh optimize(const VertexFormat& format, const void* data, int vertexes);
+
+	// Average cache miss ratio (transformed vertexes per triangle) with a simulated FIFO cache
+	static float acmr(const unsigned int* indexes, int count, int cacheSize = SimulatedCacheSize);
+
+private:
+	static constexpr int SimulatedCacheSize = 16;
+
+	// Merge identical vertexes, returns unique vertex count
+	static int deduplicate(const VertexFormat& format, const void* data, int vertexes,
+						   std::vector<unsigned char>& vertices, std::vector<unsigned int>& indexes);
+	// Reorder triangles for vertex cache locality
+	static void optimizeVertexCache(std::vector<unsigned int>& indexes, int vertexCount);
+	// Reorder vertexes by first use
+	static void optimizeVertexFetch(int vertexSize, std::vector<unsigned char>& vertices, std::vector<unsigned int>& indexes);
+};
+
+#endif // !MESHOPTIMIZER_H_
@@ -0,0 +1,152 @@
+#include "mipchain.h"
+#include <algorithm>
+#include <cmath>
+#include "imagekernels.h"
+#include "threadpool.h"
+
+namespace {
+	// sRGB <-> linear conversion tables (12-bit linear precision on the way back)
+	struct SRGBTables {
+		static constexpr int LinearSteps = 4095;
+		float toLinear[256];
+		unsigned char fromLinear[LinearSteps + 1];
+
+		SRGBTables() {
+			for (int i = 0; i < 256; i++) {
+				double c = i / 255.0;
+				toLinear[i] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+			}
+			for (int i = 0; i <= LinearSteps; i++) {
+				double l = double(i) / LinearSteps;
+				double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+				fromLinear[i] = static_cast<unsigned char>(std::min(std::max(c * 255.0 + 0.5, 0.0), 255.0));
+			}
+		}
+	};
+
+	const SRGBTables& srgbTables() {
+		static const SRGBTables res;
+		return res;
+	}
+
+	// Source pixels averaged into a destination pixel along one axis:
+	// 2 for even sizes, 3 with area weights for odd sizes (2n + 1 -> n)
+	struct Taps {
+		int first, count;
+		float weights[3];
+	};
+
+	Taps taps(int index, int srcSize, int dstSize) {
+		Taps res;
+		if (srcSize == 1) {
+			res.first = 0, res.count = 1, res.weights[0] = 1.0f;
+		} else if (srcSize % 2 == 0) {
+			res.first = index * 2, res.count = 2, res.weights[0] = res.weights[1] = 0.5f;
+		} else {
+			float n = float(dstSize), size = float(srcSize);
+			res.first = index * 2, res.count = 3;
+			res.weights[0] = (n - index) / size, res.weights[1] = n / size, res.weights[2] = (index + 1) / size;
+		}
+		return res;
+	}
+}
+
+int MipChain::fullLevels(int width, int height) {
+	int res = 1;
+	for (int size = std::max(width, height); size > 1; size /= 2) res++;
+	return res;
+}
+
+MipChain::MipChain(const TextureImage& image, int maxLevels, bool srgb): mBase(image.compact() ? image : image.clone()) {
+	int count = fullLevels(image.width(), image.height());
+	if (maxLevels >= 0) count = std::min(count, std::max(maxLevels, 1));
+
+	// Lay out all levels below the base one, then allocate once
+	size_t size = 0;
+	mLevels.push_back({ mBase.width(), mBase.height(), mBase.pitch(), 0 });
+	for (int i = 1; i < count; i++) {
+		Level curr;
+		curr.width = std::max(mLevels[i - 1].width / 2, 1);
+		curr.height = std::max(mLevels[i - 1].height / 2, 1);
+		curr.pitch = TextureImage::alignedPitch(curr.width * image.bytesPerPixel());
+		curr.offset = size;
+		size += size_t(curr.pitch) * curr.height;
+		mLevels.push_back(curr);
+	}
+	mAllocated = size;
+	if (size > 0) mData.reset(new unsigned char[size], std::default_delete<unsigned char[]>());
+	for (int i = 1; i < count; i++) reduce(i, srgb);
+}
+
+TextureImage MipChain::level(int level) const {
+	if (level == 0) return mBase;
+	const Level& curr = mLevels[level];
+	return TextureImage(mData, mData.get() + curr.offset, curr.width, curr.height, bytesPerPixel(), curr.pitch);
+}
+
+void MipChain::reduce(int level, bool srgb) {
+	const Level& src = mLevels[level - 1];
+	const Level& dst = mLevels[level];
+	const unsigned char* srcData = data(level - 1);
+	unsigned char* dstData = levelData(level);
+	int bpp = bytesPerPixel();
+	// Rows per task, so that small levels are not split
+	int grain = std::max(1, 16384 / dst.width);
+	// Masks & gray images are averaged as stored
+	if (bpp < 3) srgb = false;
+
+	if (!srgb && src.width % 2 == 0 && src.height % 2 == 0) {
+		// Plain 2x2 average
+		ThreadPool::parallelFor(dst.height, grain, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				const unsigned char* row = srcData + size_t(i) * 2 * src.pitch;
+				ImageKernels::shrink2(row, row + src.pitch, dstData + size_t(i) * dst.pitch, dst.width, bpp);
+			}
+		});
+		return;
+	}
+
+	const SRGBTables& tables = srgbTables();
+	if (src.width % 2 == 0 && src.height % 2 == 0) {
+		// 2x2 average in linear space
+		ThreadPool::parallelFor(dst.height, grain, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				const unsigned char* row0 = srcData + size_t(i) * 2 * src.pitch, * row1 = row0 + src.pitch;
+				unsigned char* out = dstData + size_t(i) * dst.pitch;
+				for (int j = 0; j < dst.width; j++, row0 += bpp * 2, row1 += bpp * 2, out += bpp) {
+					for (int k = 0; k < std::min(bpp, 3); k++) {
+						float sum = tables.toLinear[row0[k]] + tables.toLinear[row0[k + bpp]] + tables.toLinear[row1[k]] + tables.toLinear[row1[k + bpp]];
+						out[k] = tables.fromLinear[int(sum * (SRGBTables::LinearSteps / 4.0f) + 0.5f)];
+					}
+					if (bpp == 4) out[3] = static_cast<unsigned char>((row0[3] + row0[7] + row1[3] + row1[7] + 2) >> 2);
+				}
+			}
+		});
+		return;
+	}
+
+	std::vector<Taps> columns(dst.width);
+	for (int j = 0; j < dst.width; j++) columns[j] = taps(j, src.width, dst.width);
+	ThreadPool::parallelFor(dst.height, grain, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Taps rows = taps(i, src.height, dst.height);
+			unsigned char* out = dstData + size_t(i) * dst.pitch;
+			for (int j = 0; j < dst.width; j++, out += bpp) {
+				const Taps& cols = columns[j];
+				for (int k = 0; k < bpp; k++) {
+					// Alpha stays linear
+					bool linearize = srgb && k < 3;
+					float sum = 0.0f;
+					for (int y = 0; y < rows.count; y++) {
+						const unsigned char* p = srcData + size_t(rows.first + y) * src.pitch + cols.first * bpp + k;
+						float rowSum = 0.0f;
+						for (int x = 0; x < cols.count; x++, p += bpp) rowSum += cols.weights[x] * (linearize ? tables.toLinear[*p] : float(*p));
+						sum += rows.weights[y] * rowSum;
+					}
+					if (linearize) out[k] = tables.fromLinear[std::min(int(sum * SRGBTables::LinearSteps + 0.5f), int(SRGBTables::LinearSteps))];
+					else out[k] = static_cast<unsigned char>(std::min(int(sum + 0.5f), 255));
+				}
+			}
+		}
+	});
+}
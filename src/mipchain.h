@@ -0,0 +1,47 @@
+#ifndef MIPCHAIN_H_
+#define MIPCHAIN_H_
+
+#include <vector>
+#include "texture.h"
+
+// Mipmap pyramid of an image. The base level shares the pixels of the image (copied if it is a view),
+// all smaller levels are computed into one allocation (1/3 of the base level at most).
+class MipChain {
+public:
+	// Compute up to `maxLevels` levels including the base one (all when negative).
+	// With `srgb`, color channels of RGB/RGBA images are averaged in linear space.
+	MipChain(const TextureImage& image, int maxLevels = -1, bool srgb = false);
+
+	// Number of levels of a full chain (down to 1x1)
+	static int fullLevels(int width, int height);
+
+	int levels() const { return int(mLevels.size()); }
+	int bytesPerPixel() const { return mBase.bytesPerPixel(); }
+	int width(int level) const { return mLevels[level].width; }
+	int height(int level) const { return mLevels[level].height; }
+	int pitch(int level) const { return mLevels[level].pitch; }
+	const unsigned char* data(int level) const {
+		return level == 0 ? mBase.data() : mData.get() + mLevels[level].offset;
+	}
+	// Level as an image sharing the pixels of the chain
+	TextureImage level(int level) const;
+	// Bytes allocated for levels below the base one
+	size_t allocated() const { return mAllocated; }
+
+private:
+	struct Level {
+		int width, height, pitch;
+		size_t offset;
+	};
+
+	TextureImage mBase;
+	std::vector<Level> mLevels;
+	std::shared_ptr<unsigned char> mData;
+	size_t mAllocated = 0;
+
+	unsigned char* levelData(int level) { return mData.get() + mLevels[level].offset; }
+	// Compute level from the previous one
+	void reduce(int level, bool srgb);
+};
+
+#endif // !MIPCHAIN_H_
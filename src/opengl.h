@@ -9,6 +9,12 @@ using TextureID = GLuint;
 using TextureFormat = GLenum;
 constexpr TextureFormat TextureFormatRGB = GL_RGB;
 constexpr TextureFormat TextureFormatRGBA = GL_RGBA;
+using VertexAttribType = GLenum;
+constexpr VertexAttribType VertexAttribFloat = GL_FLOAT;
+constexpr VertexAttribType VertexAttribHalfFloat = GL_HALF_FLOAT;
+constexpr VertexAttribType VertexAttribShort = GL_SHORT;
+constexpr VertexAttribType VertexAttribUnsignedShort = GL_UNSIGNED_SHORT;
+constexpr VertexAttribType VertexAttribUnsignedByte = GL_UNSIGNED_BYTE;
 
 class OpenGL {
 public:
@@ -1,10 +1,11 @@
 #include "renderer.h"
 #include <sstream>
 #include "common.h"
+#include "streamingvertexbuffer.h"
 
 int Renderer::matrixMode = 0;
 Mat4f Renderer::mProjection(1.0f), Renderer::mModelview(1.0f);
-ShaderProgram Renderer::mFinal;
+ShaderProgram Renderer::mFinal, Renderer::mInstanced;
 
 void Renderer::init() {
 	glShadeModel(GL_SMOOTH);
@@ -16,9 +17,17 @@ void Renderer::init() {
 	glStencilFunc(GL_ALWAYS, 0, 0xFF);
 	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
+	StreamingVertexBuffer::init();
+
 	if (OpenGL::coreProfile()) {
 		mFinal.loadShadersFromFile(std::string(ShaderPath) + "Final.vsh", std::string(ShaderPath) + "Final.fsh");
 		mFinal.bind();
+	} else {
+		GLuint loc = InstanceBuffer::AttribLocation;
+		mInstanced.loadShadersFromFile(std::string(ShaderPath) + "Instanced.vsh", std::string(ShaderPath) + "Instanced.fsh", {
+			{ "InstanceTransform0", loc }, { "InstanceTransform1", loc + 1 }, { "InstanceTransform2", loc + 2 },
+			{ "InstanceColor", loc + 3 }, { "InstanceTexRect", loc + 4 }
+		});
 	}
 	
 	enableCullFace();
@@ -30,6 +39,11 @@ void Renderer::init() {
 	setClearDepth(1.0f);
 }
 
+void Renderer::destroy() {
+	StreamingVertexBuffer::destroy();
+	IndexBuffer::releaseQuads();
+}
+
 void Renderer::checkError() {
 	GLenum err = glGetError();
 	if (err) {
@@ -12,6 +12,8 @@ class Renderer {
 public:
 	// Set up rendering. Must be called after OpenGL context is available!
 	static void init();
+	// Release shared buffers (streaming vertexes, quad indexes). Must be called before OpenGL context is destroyed!
+	static void destroy();
 
 	static void beginFinalPass() { mFinal.bind(); }
 	static void endFinalPass() { mFinal.unbind(); }
@@ -88,11 +90,13 @@ public:
 	static void checkError();
 	
 	static ShaderProgram& shader() { return mFinal; }
+	// Shader for VertexBuffer::renderInstanced() (compatibility profile only)
+	static ShaderProgram& instancedShader() { return mInstanced; }
 
 private:
 	static int matrixMode;
 	static Mat4f mProjection, mModelview;
-	static ShaderProgram mFinal;
+	static ShaderProgram mFinal, mInstanced;
 
 	static void updateMatrices() {
 		if (!OpenGL::coreProfile()) {
@@ -0,0 +1,110 @@
+#include "renderqueue.h"
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include "renderer.h"
+#include "streamingvertexbuffer.h"
+#include "framearena.h"
+
+std::vector<RenderQueue::Item> RenderQueue::mItems;
+int RenderQueue::mLastDrawCount = 0;
+
+bool RenderQueue::State::operator==(const State& r) const {
+	return layer == r.layer && program == r.program && bind == r.bind && texture == r.texture && blend == r.blend
+		&& std::equal(params, params + 4, r.params);
+}
+
+bool RenderQueue::State::operator<(const State& r) const {
+	if (layer != r.layer) return layer < r.layer;
+	if (program != r.program) return std::less<const ShaderProgram*>()(program, r.program);
+	if (texture != r.texture) return texture < r.texture;
+	if (blend != r.blend) return blend < r.blend;
+	if (bind != r.bind) return std::less<void (*)(const State&)>()(bind, r.bind);
+	return std::lexicographical_compare(params, params + 4, r.params, r.params + 4);
+}
+
+void RenderQueue::submitQuads(const State& state, const VertexFormat& format, const void* data, int vertexes) {
+	if (vertexes == 0) return;
+	size_t size = size_t(vertexes) * format.vertexSize();
+	void* copy = FrameArena::allocate(size);
+	memcpy(copy, data, size);
+	mItems.push_back(Item{ state, format, copy, vertexes, int(mItems.size()) });
+}
+
+void RenderQueue::apply(const State& state, const State* prev) {
+	bool program = prev == nullptr || prev->program != state.program;
+	if (program) {
+		if (state.program != nullptr) state.program->bind();
+		else if (OpenGL::coreProfile()) Renderer::shader().bind();
+		else ShaderProgram::unbind();
+	}
+	if (state.bind != nullptr && (program || prev->bind != state.bind || !std::equal(state.params, state.params + 4, prev->params)))
+		state.bind(state);
+	if (prev == nullptr || prev->texture != state.texture) {
+		if (state.texture != 0) {
+			Renderer::enableTexture2D();
+			glBindTexture(GL_TEXTURE_2D, state.texture);
+		} else Renderer::disableTexture2D();
+	}
+	if (prev == nullptr || prev->blend != state.blend) {
+		if (state.blend) Renderer::enableBlend();
+		else Renderer::disableBlend();
+	}
+}
+
+RenderQueue::Saved RenderQueue::save() {
+	Saved res;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &res.program);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &res.texture);
+	res.texture2D = !OpenGL::coreProfile() && glIsEnabled(GL_TEXTURE_2D);
+	res.blend = glIsEnabled(GL_BLEND) != GL_FALSE;
+	return res;
+}
+
+void RenderQueue::restore(const Saved& saved) {
+	glUseProgram(GLuint(saved.program));
+	glBindTexture(GL_TEXTURE_2D, GLuint(saved.texture));
+	if (saved.texture2D) Renderer::enableTexture2D();
+	else Renderer::disableTexture2D();
+	if (saved.blend) Renderer::enableBlend();
+	else Renderer::disableBlend();
+}
+
+void RenderQueue::flush() {
+	mLastDrawCount = 0;
+	if (mItems.empty()) return;
+	// Submission order breaks ties, so that merged vertex data keeps it as well
+	std::sort(mItems.begin(), mItems.end(), [](const Item& l, const Item& r) {
+		if (l.state != r.state) return l.state < r.state;
+		if (l.format != r.format) return l.format < r.format;
+		return l.index < r.index;
+	});
+	Saved saved = save();
+
+	const State* prev = nullptr;
+	for (size_t i = 0, j; i < mItems.size(); i = j) {
+		const Item& first = mItems[i];
+		int vertexes = first.vertexes;
+		for (j = i + 1; j < mItems.size() && mItems[j].state == first.state && mItems[j].format == first.format; j++)
+			vertexes += mItems[j].vertexes;
+
+		// Merge vertex data of the run
+		const void* data = first.data;
+		if (j - i > 1) {
+			size_t stride = first.format.vertexSize();
+			unsigned char* merged = static_cast<unsigned char*>(FrameArena::allocate(vertexes * stride));
+			for (size_t k = i, offset = 0; k < j; k++) {
+				memcpy(merged + offset, mItems[k].data, mItems[k].vertexes * stride);
+				offset += mItems[k].vertexes * stride;
+			}
+			data = merged;
+		}
+
+		apply(first.state, prev);
+		StreamingVertexBuffer::renderQuads(first.format, data, vertexes);
+		mLastDrawCount++;
+		prev = &first.state;
+	}
+	restore(saved);
+	mItems.clear();
+}
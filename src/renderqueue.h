@@ -0,0 +1,69 @@
+#ifndef RENDERQUEUE_H_
+#define RENDERQUEUE_H_
+
+#include <vector>
+#include "opengl.h"
+#include "vertexarray.h"
+#include "shader.h"
+
+// Deferred submission of transient quads (GUI, text...)
+// Items are sorted by layer & render state on flush(), adjacent items sharing state are merged into single draws.
+// Painter order is only kept between layers: items on the same layer must not overlap!
+class RenderQueue {
+public:
+	struct State {
+		// Drawing order, lower layers first
+		int layer = 0;
+		// Shader program (nullptr: default program)
+		const ShaderProgram* program = nullptr;
+		// Sets uniforms from params after the program is bound
+		void (*bind)(const State& state) = nullptr;
+		float params[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		// 2D texture (0: untextured)
+		TextureID texture = 0;
+		bool blend = true;
+
+		bool operator==(const State& r) const;
+		bool operator!=(const State& r) const { return !(*this == r); }
+		bool operator<(const State& r) const;
+	};
+
+	// Queue quads, 4 vertexes each (see VertexArrayT::addQuad()). Data is copied
+	static void submitQuads(const State& state, const VertexFormat& format, const void* data, int vertexes);
+	template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+			  VertexAttribType TexType, VertexAttribType ColType, VertexAttribType NormType, VertexAttribType CoordType>
+	static void submitQuads(const State& state, const VertexArrayT<Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType>& va) {
+		submitQuads(state, va.format(), va.data(), va.vertexCount());
+	}
+	// Draw & remove all queued items, then restore the program, texture & blending current before.
+	// Must be called before changing any other render state (stencil...)
+	static void flush();
+	// Draw calls issued by the last flush()
+	static int lastDrawCount() { return mLastDrawCount; }
+
+private:
+	struct Item {
+		State state;
+		VertexFormat format;
+		const void* data;
+		int vertexes;
+		// Submission order
+		int index;
+	};
+
+	// Render state set by apply(), as it was before flush()
+	struct Saved {
+		GLint program = 0, texture = 0;
+		bool texture2D = false, blend = false;
+	};
+
+	static std::vector<Item> mItems;
+	static int mLastDrawCount;
+
+	// Set render state, skipping what is already set by prev (if any)
+	static void apply(const State& state, const State* prev);
+	static Saved save();
+	static void restore(const Saved& saved);
+};
+
+#endif // !RENDERQUEUE_H_
@@ -0,0 +1,232 @@
+#include "screenshot.h"
+#include <ctime>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#ifdef PROJECTNAME_TARGET_WINDOWS
+#	include <direct.h>
+#else
+#	include <sys/stat.h>
+#endif
+#include "config.h"
+#include "logger.h"
+#include "bitmap.h"
+#include "framebuffer.h"
+#include "imagekernels.h"
+
+constexpr int Screenshot::Latency;
+constexpr int Screenshot::MaxLatency;
+
+std::thread Screenshot::mThread;
+std::mutex Screenshot::mMutex;
+std::condition_variable Screenshot::mWake;
+bool Screenshot::mQuit = false;
+std::deque<Screenshot::Readback> Screenshot::mQueued, Screenshot::mWritten;
+int Screenshot::mWriting = 0;
+std::deque<Screenshot::Readback> Screenshot::mReadbacks;
+std::vector<Screenshot::Readback> Screenshot::mFree;
+bool Screenshot::mPBOs = false, Screenshot::mFences = false, Screenshot::mPNG = true;
+unsigned long long Screenshot::mFrame = 0;
+
+namespace {
+	std::string extension(const std::string& filename) {
+		std::string res = filename.substr(std::min(filename.rfind('.'), filename.size()));
+		std::transform(res.begin(), res.end(), res.begin(), [](char c) { return char(tolower(c)); });
+		return res;
+	}
+}
+
+void Screenshot::init() {
+	if (mThread.joinable()) return;
+	mPNG = extension("." + Config::getString("Screenshot.Format", "png")) != ".bmp";
+	mPBOs = GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+	mFences = mPBOs && GLEW_ARB_sync;
+	mFrame = 0;
+#ifdef PROJECTNAME_TARGET_WINDOWS
+	_mkdir(ScreenshotPath);
+#else
+	mkdir(ScreenshotPath, 0755);
+#endif
+	mQuit = false;
+	mThread = std::thread(worker);
+	std::stringstream ss;
+	ss << "Screenshots: " << (mPNG ? "PNG" : "BMP") << ", " << (mPBOs ? (mFences ? "pixel buffer read backs with fences" : "pixel buffer read backs") : "direct read backs");
+	LogInfo(ss.str());
+}
+
+void Screenshot::destroy() {
+	if (!mThread.joinable()) return;
+	// Mapping waits for the GPU, the writer thread finishes queued files before quitting
+	while (!mReadbacks.empty()) {
+		finish(mReadbacks.front());
+		mReadbacks.pop_front();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	mThread.join();
+	recycle();
+	for (auto& curr: mFree) glDeleteBuffers(1, &curr.pbo);
+	mFree.clear();
+}
+
+void Screenshot::capture(int width, int height, const std::string& filename) {
+	if (!mThread.joinable() || width <= 0 || height <= 0) return;
+	Readback readback;
+	if (mPBOs && !mFree.empty()) {
+		readback = std::move(mFree.back());
+		mFree.pop_back();
+	}
+	readback.width = width, readback.height = height;
+	readback.filename = filename.empty() ? defaultFilename() : filename;
+	std::string ext = extension(readback.filename);
+	readback.png = ext == ".png" || (ext != ".bmp" && mPNG);
+	readback.frame = mFrame;
+
+	// 4-byte pixels in the order of the output (BMP stores BGR), so that the writer only drops alpha.
+	// Both are bottom-up, like BMP files.
+	GLenum format = readback.png ? GL_RGBA : GL_BGRA;
+	size_t size = size_t(width) * height * 4;
+	FrameBuffer::unbindRead();
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	if (!mPBOs) {
+		// Stalls until rendering is complete, but still writes in the background
+		readback.pixels.resize(size);
+		glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, readback.pixels.data());
+		readback.data = readback.pixels.data();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQueued.push_back(std::move(readback));
+		}
+		mWake.notify_one();
+		return;
+	}
+
+	if (readback.pbo == 0) glGenBuffers(1, &readback.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	if (readback.size < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		readback.size = size;
+	}
+	glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (mFences) readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mReadbacks.push_back(std::move(readback));
+}
+
+void Screenshot::update() {
+	if (!mThread.joinable()) return;
+	mFrame++;
+	recycle();
+	// In capture order, stop at the first one the GPU may not have finished
+	while (!mReadbacks.empty()) {
+		Readback& curr = mReadbacks.front();
+		unsigned long long frames = mFrame - curr.frame;
+		bool done = frames >= MaxLatency;
+		if (curr.fence != nullptr) {
+			GLenum res = glClientWaitSync(curr.fence, 0, 0);
+			done = done || res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED;
+		} else done = done || frames >= Latency;
+		if (!done) break;
+		finish(curr);
+		mReadbacks.pop_front();
+	}
+}
+
+int Screenshot::pending() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return int(mReadbacks.size() + mQueued.size()) + mWriting;
+}
+
+void Screenshot::finish(Readback& readback) {
+	if (readback.fence != nullptr) glDeleteSync(readback.fence);
+	readback.fence = nullptr;
+	// Stays mapped while the writer thread reads it (see recycle())
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	readback.data = static_cast<const unsigned char*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (readback.data == nullptr) {
+		LogWarning("Failed to map screenshot \"" + readback.filename + "\"");
+		mFree.push_back(std::move(readback));
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueued.push_back(std::move(readback));
+	}
+	mWake.notify_one();
+}
+
+void Screenshot::recycle() {
+	std::deque<Readback> written;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		written.swap(mWritten);
+	}
+	for (auto& curr: written) {
+		if (curr.pbo == 0) continue;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, curr.pbo);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		curr.data = nullptr;
+		mFree.push_back(std::move(curr));
+	}
+}
+
+void Screenshot::worker() {
+	while (true) {
+		Readback image;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [] { return mQuit || !mQueued.empty(); });
+			if (mQueued.empty()) return;
+			image = std::move(mQueued.front());
+			mQueued.pop_front();
+			mWriting++;
+		}
+		if (write(image)) LogInfo("Screenshot saved to \"" + image.filename + "\"");
+		image.pixels.clear();
+		image.pixels.shrink_to_fit();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mWriting--;
+			mWritten.push_back(std::move(image));
+		}
+	}
+}
+
+bool Screenshot::write(const Readback& image) {
+	int w = image.width, h = image.height;
+	int pitch = (w * 3 + 3) / 4 * 4;
+	std::vector<unsigned char> rows(size_t(pitch) * h, 0);
+	if (!image.png) {
+		// BGRA to BGR, rows already bottom-up
+		for (int i = 0; i < h; i++) ImageKernels::rgbaToRGB(image.data + size_t(i) * w * 4, rows.data() + size_t(i) * pitch, w);
+		return Bitmap::saveBGR(image.filename, rows.data(), w, h);
+	}
+	// Flip & drop alpha in one pass
+	for (int i = 0; i < h; i++) ImageKernels::rgbaToRGB(image.data + size_t(h - 1 - i) * w * 4, rows.data() + size_t(i) * pitch, w);
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom(rows.data(), w, h, 24, pitch, SDL_PIXELFORMAT_RGB24);
+	bool res = surface != nullptr && IMG_SavePNG(surface, image.filename.c_str()) == 0;
+	if (surface != nullptr) SDL_FreeSurface(surface);
+	if (!res) LogWarning("Could not save screenshot \"" + image.filename + "\": " + IMG_GetError());
+	return res;
+}
+
+std::string Screenshot::defaultFilename() {
+	auto now = std::chrono::system_clock::now();
+	std::time_t time = std::chrono::system_clock::to_time_t(now);
+	int millis = int(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+	char stamp[32];
+	std::strftime(stamp, sizeof(stamp), "%Y-%m-%d_%H-%M-%S", std::localtime(&time));
+	std::stringstream ss;
+	ss << ScreenshotPath << "Screenshot_" << stamp << "-" << std::setw(3) << std::setfill('0') << millis << (mPNG ? ".png" : ".bmp");
+	return ss.str();
+}
@@ -0,0 +1,71 @@
+#ifndef SCREENSHOT_H_
+#define SCREENSHOT_H_
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "opengl.h"
+
+// Captures the window without stalling the frame: pixels are read back into pixel buffer objects,
+// which are mapped a few frames later once the GPU has finished (fences when supported), then flipped,
+// swizzled and encoded to PNG or BMP ("Screenshot.Format") on a writer thread.
+class Screenshot {
+public:
+	// Start the writer thread. Must be called after OpenGL context is available!
+	static void init();
+	// Finish captures in flight and wait for the files to be written
+	static void destroy();
+
+	// Read back the back buffer of the current window (after rendering it, before swapping buffers).
+	// Written to `filename` (format by extension), or to a time-stamped file in ScreenshotPath when empty.
+	static void capture(int width, int height, const std::string& filename = "");
+	// Hand finished read backs to the writer thread. Call once per frame.
+	static void update();
+
+	// Captures not written yet
+	static int pending();
+
+private:
+	// Frames before a read back is mapped without fences, and at most with them
+	static constexpr int Latency = 2, MaxLatency = 8;
+
+	struct Readback {
+		VertexBufferID pbo = 0;
+		GLsync fence = nullptr;
+		size_t size = 0;
+		int width = 0, height = 0;
+		bool png = false;
+		unsigned long long frame = 0;
+		std::string filename;
+		// Bottom-up rows of 4-byte pixels (RGBA for PNG, BGRA for BMP): the mapped pixel buffer,
+		// or `pixels` when read back directly
+		const unsigned char* data = nullptr;
+		std::vector<unsigned char> pixels;
+	};
+
+	static std::thread mThread;
+	static std::mutex mMutex;
+	static std::condition_variable mWake;
+	static bool mQuit;
+	// Mapped & waiting for the writer thread, being written, and written ones waiting to be unmapped
+	static std::deque<Readback> mQueued, mWritten;
+	static int mWriting;
+	// Read backs in flight (oldest first) and pixel buffers free for reuse
+	static std::deque<Readback> mReadbacks;
+	static std::vector<Readback> mFree;
+	static bool mPBOs, mFences, mPNG;
+	static unsigned long long mFrame;
+
+	static void worker();
+	static bool write(const Readback& image);
+	// Map read back & queue it for writing
+	static void finish(Readback& readback);
+	// Unmap written pixel buffers for reuse
+	static void recycle();
+	static std::string defaultFilename();
+};
+
+#endif // !SCREENSHOT_H_
@@ -57,7 +57,8 @@ void Shader::loadFromFile(GLenum type, const std::string& filename) {
 	checkCompilation(mHandle, "Shader compilation error: \"" + filename + "\"");
 }
 
-void ShaderProgram::loadShadersFromFile(const std::string& vertex, const std::string& fragment) {
+void ShaderProgram::loadShadersFromFile(const std::string& vertex, const std::string& fragment,
+										const std::vector<std::pair<std::string, GLuint> >& attribLocations) {
 	mVertex.loadFromFile(GL_VERTEX_SHADER, vertex);
 	mFragment.loadFromFile(GL_FRAGMENT_SHADER, fragment);
 	if (mVertex.type() != GL_VERTEX_SHADER || mFragment.type() != GL_FRAGMENT_SHADER) {
@@ -67,6 +68,7 @@ void ShaderProgram::loadShadersFromFile(const std::string& vertex, const std::st
 	mHandle = glCreateProgram();
 	glAttachShader(mHandle, mVertex.handle());
 	glAttachShader(mHandle, mFragment.handle());
+	for (const auto& curr: attribLocations) glBindAttribLocation(mHandle, curr.second, curr.first.c_str());
 	glLinkProgram(mHandle);
 	checkLinking(mHandle, "Shader program linking error:");
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <utility>
 #include "opengl.h"
 
 class Shader {
@@ -27,7 +29,9 @@ public:
 	
 	GLuint handle() const noexcept { return mHandle; }
 
-	void loadShadersFromFile(const std::string& vertex, const std::string& fragment);
+	// Attribute locations given are bound before linking
+	void loadShadersFromFile(const std::string& vertex, const std::string& fragment,
+							 const std::vector<std::pair<std::string, GLuint> >& attribLocations = {});
 
 	void bind() const { glUseProgram(mHandle); }
 	static void unbind() { glUseProgram(0); }
@@ -0,0 +1,152 @@
+#include "streamingvertexbuffer.h"
+#include <cstring>
+#include "config.h"
+#include "logger.h"
+
+VertexBufferID StreamingVertexBuffer::mID = 0;
+size_t StreamingVertexBuffer::mSize = 0, StreamingVertexBuffer::mOffset = 0;
+int StreamingVertexBuffer::mSegment = 0;
+unsigned char* StreamingVertexBuffer::mMapped = nullptr;
+GLsync StreamingVertexBuffer::mFences[SegmentCount];
+bool StreamingVertexBuffer::mBaseVertex = false;
+std::map<VertexFormat, VertexBufferID> StreamingVertexBuffer::mVAOs;
+
+void StreamingVertexBuffer::init() {
+	if (mID != 0) return;
+	mSize = size_t(Config::getInt("OpenGL.StreamingBufferKB", 4096)) * 1024;
+	mOffset = 0;
+	mSegment = 0;
+	for (int i = 0; i < SegmentCount; i++) mFences[i] = nullptr;
+	mBaseVertex = GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex;
+
+	glGenBuffers(1, &mID);
+	glBindBuffer(GL_ARRAY_BUFFER, mID);
+	if (GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, mSize, nullptr, flags);
+		mMapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, mSize, flags));
+	}
+	if (mMapped == nullptr) {
+		glBufferData(GL_ARRAY_BUFFER, mSize, nullptr, GL_STREAM_DRAW);
+		LogInfo("Streaming vertex buffer: orphaning");
+	} else LogInfo("Streaming vertex buffer: persistent mapping");
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamingVertexBuffer::destroy() {
+	if (mID == 0) return;
+	for (int i = 0; i < SegmentCount; i++) if (mFences[i] != nullptr) {
+		glDeleteSync(mFences[i]);
+		mFences[i] = nullptr;
+	}
+	if (mMapped != nullptr) {
+		glBindBuffer(GL_ARRAY_BUFFER, mID);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		mMapped = nullptr;
+	}
+	for (auto& curr: mVAOs) glDeleteVertexArrays(1, &curr.second);
+	mVAOs.clear();
+	glDeleteBuffers(1, &mID);
+	mID = 0;
+}
+
+void StreamingVertexBuffer::waitSegment(int index) {
+	if (mFences[index] == nullptr) return;
+	GLenum res;
+	do res = glClientWaitSync(mFences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	while (res == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(mFences[index]);
+	mFences[index] = nullptr;
+}
+
+void StreamingVertexBuffer::fenceSegment(int index) {
+	if (mFences[index] != nullptr) glDeleteSync(mFences[index]);
+	mFences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamingVertexBuffer::Range StreamingVertexBuffer::append(const VertexFormat& format, const void* data, int vertexes) {
+	Assert(mID != 0, "Streaming vertex buffer used before initialization");
+	Assert(fits(format, vertexes));
+	Range res;
+	res.format = format;
+	if (vertexes == 0) return res;
+
+	// Keep offsets multiples of vertex size so that they can be used as the first vertex index
+	size_t stride = format.vertexSize(), bytes = size_t(vertexes) * stride;
+	size_t offset = (mOffset + stride - 1) / stride * stride;
+	size_t segmentSize = mSize / SegmentCount;
+	if (mMapped != nullptr) {
+		// Ranges never straddle segments: a segment is only fenced once left, after the draws reading it were issued
+		size_t next = (offset / segmentSize + 1) * segmentSize;
+		if (offset + bytes > next) offset = (next + stride - 1) / stride * stride;
+	}
+	bool wrapped = false;
+	if (offset + bytes > mSize) offset = 0, wrapped = true;
+
+	if (mMapped != nullptr) {
+		// Fence segments left behind, wait for segments entered
+		int last = int(offset / segmentSize);
+		while (mSegment != last) {
+			fenceSegment(mSegment);
+			mSegment = (mSegment + 1) % SegmentCount;
+			waitSegment(mSegment);
+		}
+		memcpy(mMapped + offset, data, bytes);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, mID);
+		if (wrapped) glBufferData(GL_ARRAY_BUFFER, mSize, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	mOffset = offset + bytes;
+	res.first = int(offset / stride);
+	res.count = vertexes;
+	return res;
+}
+
+VertexBufferID StreamingVertexBuffer::vao(const VertexFormat& format) {
+	auto it = mVAOs.find(format);
+	if (it != mVAOs.end()) return it->second;
+	VertexBufferID res = 0;
+	glGenVertexArrays(1, &res);
+	glBindVertexArray(res);
+	glBindBuffer(GL_ARRAY_BUFFER, mID);
+	VertexBuffer::setAttribPointers(format);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mVAOs[format] = res;
+	return res;
+}
+
+int StreamingVertexBuffer::bind(const Range& range) {
+	size_t offset = size_t(range.first) * range.format.vertexSize();
+	if (!OpenGL::coreProfile()) {
+		// Pointers are specified for every draw anyway
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, mID);
+		VertexBuffer::setClientStatePointers(range.format, offset);
+		return 0;
+	}
+	glBindVertexArray(vao(range.format));
+	if (mBaseVertex) return range.first;
+	glBindBuffer(GL_ARRAY_BUFFER, mID);
+	VertexBuffer::setAttribPointers(range.format, offset);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return 0;
+}
+
+void StreamingVertexBuffer::render(const Range& range) {
+	if (range.count == 0) return;
+	glDrawArrays(GL_TRIANGLES, bind(range), range.count);
+}
+
+void StreamingVertexBuffer::renderQuads(const Range& range) {
+	Assert(range.count % 4 == 0);
+	int quads = range.count / 4;
+	if (quads == 0) return;
+	const IndexBuffer& indexes = IndexBuffer::quads(quads);
+	int first = bind(range);
+	indexes.bind();
+	if (first != 0) glDrawElementsBaseVertex(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, nullptr, first);
+	else glDrawElements(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, nullptr);
+}
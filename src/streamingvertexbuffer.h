@@ -0,0 +1,81 @@
+#ifndef STREAMINGVERTEXBUFFER_H_
+#define STREAMINGVERTEXBUFFER_H_
+
+#include <map>
+#include "opengl.h"
+#include "vertexarray.h"
+
+// Ring buffer for transient geometry rebuilt every frame (GUI, text...)
+// Persistently mapped and fenced per segment when ARB_buffer_storage is available, orphaned on wrap otherwise.
+class StreamingVertexBuffer {
+public:
+	// Vertexes written into the ring buffer. Only valid until the next call to append()!
+	struct Range {
+		int first = 0, count = 0;
+		VertexFormat format;
+	};
+
+	// Set up ring buffer. Must be called after OpenGL context is available!
+	static void init();
+	static void destroy();
+
+	// Check if given vertex data fits into the ring buffer at all (within a segment, with room to align its start)
+	static bool fits(const VertexFormat& format, int vertexes) {
+		return size_t(vertexes + 1) * format.vertexSize() <= mSize / SegmentCount;
+	}
+	// Copy vertex data into the ring buffer
+	static Range append(const VertexFormat& format, const void* data, int vertexes);
+	static Range append(const VertexArray& va) { return append(va.format(), va.data(), va.vertexCount()); }
+	// Draw vertexes previously appended
+	static void render(const Range& range);
+	// Draw quads previously appended, 4 vertexes each (see VertexArrayT::addQuad())
+	static void renderQuads(const Range& range);
+	// Append & draw (falls back to a temporary vertex buffer for oversized arrays)
+	static void render(const VertexFormat& format, const void* data, int vertexes) {
+		if (vertexes == 0) return;
+		if (!fits(format, vertexes)) {
+			VertexBuffer(format, data, vertexes).render();
+			return;
+		}
+		render(append(format, data, vertexes));
+	}
+	static void render(const VertexArray& va) { render(va.format(), va.data(), va.vertexCount()); }
+	template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+			  VertexAttribType TexType, VertexAttribType ColType, VertexAttribType NormType, VertexAttribType CoordType>
+	static void render(const VertexArrayT<Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType>& va) { render(va.format(), va.data(), va.vertexCount()); }
+	static void renderQuads(const VertexFormat& format, const void* data, int vertexes) {
+		if (vertexes == 0) return;
+		if (!fits(format, vertexes)) {
+			VertexBuffer(format, data, vertexes).renderQuads();
+			return;
+		}
+		renderQuads(append(format, data, vertexes));
+	}
+	template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+			  VertexAttribType TexType, VertexAttribType ColType, VertexAttribType NormType, VertexAttribType CoordType>
+	static void renderQuads(const VertexArrayT<Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType>& va) { renderQuads(va.format(), va.data(), va.vertexCount()); }
+
+private:
+	static constexpr int SegmentCount = 4;
+
+	static VertexBufferID mID;
+	static size_t mSize, mOffset;
+	// Segment currently being written
+	static int mSegment;
+	// Persistently mapped pointer (nullptr when orphaning)
+	static unsigned char* mMapped;
+	// Fences guarding each segment of the persistent mapping
+	static GLsync mFences[SegmentCount];
+	// Whether glDrawElementsBaseVertex() is available
+	static bool mBaseVertex;
+	// Cached VAOs (core profile)
+	static std::map<VertexFormat, VertexBufferID> mVAOs;
+
+	static VertexBufferID vao(const VertexFormat& format);
+	// Set up vertex pointers for the range, returns the index of its first vertex relative to them
+	static int bind(const Range& range);
+	static void waitSegment(int index);
+	static void fenceSegment(int index);
+};
+
+#endif // !STREAMINGVERTEXBUFFER_H_
@@ -10,6 +10,10 @@ ShaderProgram TextRenderer::mShader;
 float TextRenderer::mTextureSize, TextRenderer::mDefaultFontSize, TextRenderer::mGrayFactor, TextRenderer::mSmoothFactor;
 TextRenderer::GlyphInfo TextRenderer::mAsciiInfo[256];
 
+// Glyph vertexes: 16-bit normalized texture coordinates (core profile only), 8-bit colors
+using TextVertexArray = VertexArrayT<2, 3, 0, 3, VertexAttribUnsignedShort, VertexAttribUnsignedByte>;
+using TextVertexArrayCompat = VertexArrayT<2, 3, 0, 3, VertexAttribFloat, VertexAttribUnsignedByte>;
+
 void TextRenderer::init() {
 	std::string filename = std::string(FontPath) + Config::getString("GUI.Font", "Ascii");
 	TextureImage fontImage; fontImage.loadFromPNG(filename + ".png", true, true);
@@ -54,11 +58,12 @@ float TextRenderer::getBoxWidth(float height, const std::string& s) {
 	return res * scale;
 }
 
-void TextRenderer::drawAscii(const Vec3f& pos, const std::string& text, float size, const Vec3f& col, const Vec3f& bgcol) {
+template <typename VertexArrayType>
+void TextRenderer::submitAscii(const RenderQueue::State& state, const Vec3f& pos, const std::string& text, float size, const Vec3f& col) {
 	float scale = size / mDefaultFontSize;
 	Vec3f cpos = pos;
-	VertexArray va(text.length() * 6, VertexFormat(2, 3, 0, 3));
-	va.setColor({col.x, col.y, col.z});
+	VertexArrayType va(text.length() * 4);
+	va.setColor(col.x, col.y, col.z);
 	for (size_t i = 0; i < text.length(); i++) {
 		int curr = text[i];
 		float ext = mAsciiInfo[curr].ext;
@@ -66,31 +71,37 @@ void TextRenderer::drawAscii(const Vec3f& pos, const std::string& text, float si
 		float tw = (mAsciiInfo[curr].tw + ext * 2) / mTextureSize, th = (mAsciiInfo[curr].th + ext * 2) / mTextureSize;
 		float width = (mAsciiInfo[curr].tw + ext * 2) * scale, height = (mAsciiInfo[curr].th + ext * 2) * scale;
 		Vec3f p = cpos + Vec3f(mAsciiInfo[curr].left - ext, mAsciiInfo[curr].th - mAsciiInfo[curr].top + ext, 0.0f) * scale;
-		va.setTexture({tx, ty});
-		va.addVertex({p.x, p.y - height, p.z});
-		va.setTexture({tx, ty + th});
-		va.addVertex({p.x, p.y, p.z});
-		va.setTexture({tx + tw, ty});
-		va.addVertex({p.x + width, p.y - height, p.z});
-		va.setTexture({tx + tw, ty});
-		va.addVertex({p.x + width, p.y - height, p.z});
-		va.setTexture({tx, ty + th});
-		va.addVertex({p.x, p.y, p.z});
-		va.setTexture({tx + tw, ty + th});
-		va.addVertex({p.x + width, p.y, p.z});
+		typename VertexArrayType::Vertex* v = va.addQuad();
+		v[0].setTexture(tx, ty); v[0].setCoordinates(p.x, p.y - height, p.z);
+		v[1].setTexture(tx, ty + th); v[1].setCoordinates(p.x, p.y, p.z);
+		v[2].setTexture(tx + tw, ty); v[2].setCoordinates(p.x + width, p.y - height, p.z);
+		v[3].setTexture(tx + tw, ty + th); v[3].setCoordinates(p.x + width, p.y, p.z);
 		cpos += Vec3f(mAsciiInfo[curr].advx, mAsciiInfo[curr].advy, 0.0f) * scale;
 	}
-//	Renderer::enableAlphaTest();
-//	Renderer::setAlphaTestThreshold(0.5f);
-	mAscii.bind();
-	mShader.bind();
+	RenderQueue::submitQuads(state, va);
+}
+
+void TextRenderer::bindShader(const RenderQueue::State& state) {
 	mShader.setUniform1i("Texture", 0);
 	mShader.setUniform1f("GrayFactor", mGrayFactor);
 	mShader.setUniform1f("SmoothFactor", mSmoothFactor);
 	mShader.setUniform1f("TextureSize", mTextureSize);
-	mShader.setUniform3f("BackColor", bgcol.x, bgcol.y, bgcol.z);
-	VertexBuffer(va, false).render();
-	mShader.unbind();
-//	Renderer::setAlphaTestThreshold(0.0f);
+	mShader.setUniform3f("BackColor", state.params[0], state.params[1], state.params[2]);
 }
 
+void TextRenderer::submitAscii(int layer, const Vec3f& pos, const std::string& text, float size, const Vec3f& col, const Vec3f& bgcol) {
+	RenderQueue::State state;
+	state.layer = layer;
+	state.program = &mShader;
+	state.bind = bindShader;
+	state.params[0] = bgcol.x, state.params[1] = bgcol.y, state.params[2] = bgcol.z;
+	state.texture = mAscii.id();
+	// glTexCoordPointer() does not take normalized integers
+	if (OpenGL::coreProfile()) submitAscii<TextVertexArray>(state, pos, text, size, col);
+	else submitAscii<TextVertexArrayCompat>(state, pos, text, size, col);
+}
+
+void TextRenderer::drawAscii(const Vec3f& pos, const std::string& text, float size, const Vec3f& col, const Vec3f& bgcol) {
+	submitAscii(0, pos, text, size, col, bgcol);
+	RenderQueue::flush();
+}
@@ -5,11 +5,15 @@
 #include "vec.h"
 #include "texture.h"
 #include "shader.h"
+#include "renderqueue.h"
 
 class TextRenderer {
 public:
 	static void init();
+	// Draw text immediately (flushes the render queue)
 	static void drawAscii(const Vec3f& pos, const std::string& text, float size, const Vec3f& col, const Vec3f& bgcol);
+	// Queue text on given layer of the render queue
+	static void submitAscii(int layer, const Vec3f& pos, const std::string& text, float size, const Vec3f& col, const Vec3f& bgcol);
 	
 	static float getBoxHeight(float height, const std::string& s);
 	static float getBoxWidth(float height, const std::string& s);
@@ -24,6 +28,12 @@ private:
 	static ShaderProgram mShader;
 	static float mTextureSize, mDefaultFontSize, mGrayFactor, mSmoothFactor;
 	static GlyphInfo mAsciiInfo[256];
+
+	// Build & queue glyph quads
+	template <typename VertexArrayType>
+	static void submitAscii(const RenderQueue::State& state, const Vec3f& pos, const std::string& text, float size, const Vec3f& col);
+	// Set shader uniforms, BackColor taken from state parameters
+	static void bindShader(const RenderQueue::State& state);
 };
 
 #endif
@@ -4,36 +4,41 @@
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <vector>
 #include <SDL2/SDL_image.h>
 #include "common.h"
 #include "debug.h"
 #include "bitmap.h"
+#include "mappedfile.h"
+#include "imagekernels.h"
+#include "threadpool.h"
+#include "mipchain.h"
+#include "config.h"
 
 void TextureImage::loadFromBMP(const std::string& filename, bool checkSize, bool masked) {
-	Bitmap bmp;
-	bmp.load(filename);
+	MappedFile file;
+	int width = 0, height = 0, srcPitch = 0;
+	const unsigned char* src = file.open(filename) ? Bitmap::parse(file, width, height, srcPitch) : nullptr;
+	if (src == nullptr) {
+		LogWarning("Failed to load file \"" + filename + "\" as bitmap image: missing file or unsupported format (only uncompressed 24-bit bitmaps are supported)");
+		return;
+	}
 
-	if (checkSize && (bmp.w != bmp.h || (1 << int(log2(bmp.w))) != bmp.w)) {
+	if (checkSize && (width != height || (1 << int(log2(width))) != width)) {
 		LogWarning("Failed to load file \"" + filename + "\" as bitmap texture: unsupported image size (must be a square with side length 2 ^ n pixels)");
 		return;
 	}
 
-	mWidth = bmp.w;
-	mHeight = bmp.h;
-	mBytesPerPixel = masked ? 4 : 3;
-	mPitch = alignedPitch(mWidth * mBytesPerPixel);
+	allocate(width, height, masked ? 1 : 3);
 
-	if (masked) {
-		mData = new unsigned char[mHeight * mPitch];
-		memset(mData, 255, sizeof(unsigned char) * mHeight * mPitch);
-		for (int i = 0; i < mHeight; i++) for (int j = 0; j < mWidth; j++) {
-			mData[i * mPitch + j * mBytesPerPixel + 3] = reinterpret_cast<unsigned char*>(bmp.data)[i * bmp.pitch + j * 3];
-		}
-	} else {
-		mData = new unsigned char[mHeight * mPitch];
-		for (int i = 0; i < mHeight; i++) {
-			memcpy(mData + i * mPitch, reinterpret_cast<unsigned char*>(bmp.data) + i * bmp.pitch, mWidth * mBytesPerPixel);
-		}
+	// Flip & swizzle straight from the mapped file, touching each pixel once
+	for (int i = 0; i < mHeight; i++) {
+		const unsigned char* row = src + ptrdiff_t(i) * srcPitch;
+		unsigned char* dst = mData + size_t(i) * mPitch;
+		if (masked) {
+			// Red channel (the last one in BGR order) is the mask
+			for (int j = 0; j < mWidth; j++) dst[j] = row[j * 3 + 2];
+		} else ImageKernels::bgrToRGB(row, dst, mWidth);
 	}
 }
 
@@ -44,51 +49,79 @@ void TextureImage::loadFromPNG(const std::string& filename, bool checkSize, bool
 		return;
 	}
 
-	if (checkSize && surface->w != surface->h || (1 << int(log2(surface->w))) != surface->w) {
+	if (checkSize && (surface->w != surface->h || (1 << int(log2(surface->w))) != surface->w)) {
 		LogWarning("Failed to load file \"" + filename + "\" as PNG texture: unsupported image size (must be a square with side length 2 ^ n pixels)");
+		SDL_FreeSurface(surface);
 		return;
 	}
 
 	if (surface->format->BytesPerPixel == 1) {
-		// Grayscale / alpha
-		mWidth = surface->w;
-		mHeight = surface->h;
-		mBytesPerPixel = 4;
-		mPitch = alignedPitch(mWidth * mBytesPerPixel);
-		mData = new unsigned char[mHeight * mPitch];
-		memset(mData, 255, sizeof(unsigned char) * mHeight * mPitch);
-		for (int i = 0; i < mHeight; i++) for (int j = 0; j < mWidth; j++) {
-			unsigned char col = reinterpret_cast<unsigned char*>(surface->pixels)[i * surface->pitch + j];
-			if (masked) { // Alpha
-				mData[i * mPitch + j * mBytesPerPixel + 3] = col;
-			} else { // Grayscale
-				mData[i * mPitch + j * mBytesPerPixel + 0] = col;
-				mData[i * mPitch + j * mBytesPerPixel + 1] = col;
-				mData[i * mPitch + j * mBytesPerPixel + 2] = col;
-			}
-		}
+		// Grayscale or mask, kept single channel (read as a mask when loaded with alpha, see Texture::formats())
+		allocate(surface->w, surface->h, 1);
+		for (int i = 0; i < mHeight; i++)
+			memcpy(mData + size_t(i) * mPitch, reinterpret_cast<unsigned char*>(surface->pixels) + size_t(i) * surface->pitch, mWidth);
 	} else if (surface->format->BytesPerPixel == 3 || surface->format->BytesPerPixel == 4) {
 		// RGB / RGBA
 		if (masked) {
 			LogWarning("Failed to load file \"" + filename + "\" as mask PNG image: unsupported format (only grayscale PNG-8 is supported)");
+			SDL_FreeSurface(surface);
 			return;
 		}
-		mWidth = surface->w;
-		mHeight = surface->h;
-		mBytesPerPixel = surface->format->BytesPerPixel;
-		mPitch = alignedPitch(mWidth * mBytesPerPixel);
-		mData = new unsigned char[mHeight * mPitch];
+		// Decoded pixels are usually laid out as needed already
+		if (adopt(surface)) return;
+		allocate(surface->w, surface->h, surface->format->BytesPerPixel);
 		for (int i = 0; i < mHeight; i++) {
 			memcpy(mData + i * mPitch, reinterpret_cast<unsigned char*>(surface->pixels) + i * surface->pitch, mWidth * mBytesPerPixel);
 		}
 	} else {
 		LogWarning("Failed to load file \"" + filename + "\" as PNG image: unsupported format (only PNG-8/24/32 is supported)");
+		SDL_FreeSurface(surface);
 		return;
 	}
 
 	SDL_FreeSurface(surface);
 }
 
+bool TextureImage::adopt(SDL_Surface* surface) {
+	Uint32 format = surface->format->format;
+	int bytesPerPixel = surface->format->BytesPerPixel;
+	if ((format != SDL_PIXELFORMAT_RGB24 && format != SDL_PIXELFORMAT_RGBA32) || SDL_MUSTLOCK(surface) ||
+		surface->pitch != alignedPitch(surface->w * bytesPerPixel)) return false;
+	mWidth = surface->w;
+	mHeight = surface->h;
+	mBytesPerPixel = bytesPerPixel;
+	mPitch = surface->pitch;
+	mStorage.reset(static_cast<unsigned char*>(surface->pixels), [surface](unsigned char*) { SDL_FreeSurface(surface); });
+	mData = mStorage.get();
+	return true;
+}
+
+void TextureImage::allocate(int width, int height, int bytesPerPixel) {
+	mWidth = width;
+	mHeight = height;
+	mBytesPerPixel = bytesPerPixel;
+	mPitch = alignedPitch(mWidth * mBytesPerPixel);
+	mStorage.reset(new unsigned char[size_t(mHeight) * mPitch], std::default_delete<unsigned char[]>());
+	mData = mStorage.get();
+}
+
+TextureImage TextureImage::clone() const {
+	TextureImage res;
+	if (empty()) return res;
+	res.allocate(mWidth, mHeight, mBytesPerPixel);
+	size_t bytes = size_t(mWidth) * mBytesPerPixel;
+	if (compact()) memcpy(res.mData, mData, size_t(mHeight) * mPitch);
+	else for (int i = 0; i < mHeight; i++) memcpy(res.mData + size_t(i) * res.mPitch, mData + size_t(i) * mPitch, bytes);
+	return res;
+}
+
+TextureImage TextureImage::view(int x, int y, int width, int height) const {
+	x = std::max(x, 0), y = std::max(y, 0);
+	width = std::min(width, mWidth - x), height = std::min(height, mHeight - y);
+	if (width <= 0 || height <= 0) return TextureImage();
+	return TextureImage(mStorage, mData + size_t(y) * mPitch + size_t(x) * mBytesPerPixel, width, height, mBytesPerPixel, mPitch);
+}
+
 void TextureImage::copyFrom(const TextureImage& src, int x, int y, int srcx, int srcy) {
 	if (src.mBytesPerPixel != mBytesPerPixel) {
 		std::stringstream ss;
@@ -104,6 +137,7 @@ void TextureImage::copyFrom(const TextureImage& src, int x, int y, int srcx, int
 
 	int width = std::min(mWidth - x, src.mWidth - srcx), height = std::min(mHeight - y, src.mHeight - srcy);
 	if (width <= 0 || height <= 0) return;
+	detach();
 
 	for (int i = 0; i < height; i++) {
 		memcpy(
@@ -116,31 +150,43 @@ void TextureImage::copyFrom(const TextureImage& src, int x, int y, int srcx, int
 
 TextureImage TextureImage::convert(int bytesPerPixel) const {
 	TextureImage res(mWidth, mHeight, bytesPerPixel);
-	for (int i = 0; i < mHeight; i++)
-		for (int j = 0; j < mWidth; j++) {
-			unsigned char* p = res.mData + i * res.mPitch + j * res.mBytesPerPixel;
-			unsigned char* pSrc = mData + i * mPitch + j * mBytesPerPixel;
-			unsigned char r = 0, g = 0, b = 0, a = 255u;
-			if (mBytesPerPixel == 4) r = pSrc[0], g = pSrc[1], b = pSrc[2], a = pSrc[3];
-			else r = pSrc[0], g = pSrc[1], b = pSrc[2];
-			if (res.mBytesPerPixel == 4) p[0] = r, p[1] = g, p[2] = b, p[3] = a;
-			else p[0] = r, p[1] = g, p[2] = b;
+	for (int i = 0; i < mHeight; i++) {
+		const unsigned char* src = mData + size_t(i) * mPitch;
+		unsigned char* dst = res.mData + size_t(i) * res.mPitch;
+		if (mBytesPerPixel == 3 && bytesPerPixel == 4) ImageKernels::rgbToRGBA(src, dst, mWidth);
+		else if (mBytesPerPixel == 4 && bytesPerPixel == 3) ImageKernels::rgbaToRGB(src, dst, mWidth);
+		else if (mBytesPerPixel == bytesPerPixel) memcpy(dst, src, mWidth * bytesPerPixel);
+		else for (int j = 0; j < mWidth; j++, src += mBytesPerPixel, dst += bytesPerPixel) {
+			// Through RGBA: masks are white with alpha, gray & alpha keeps its alpha
+			unsigned char rgba[4] = { src[0], src[0], src[0], 255 };
+			if (mBytesPerPixel == 1) rgba[0] = rgba[1] = rgba[2] = 255, rgba[3] = src[0];
+			else if (mBytesPerPixel == 2) rgba[3] = src[1];
+			else rgba[1] = src[1], rgba[2] = src[2], rgba[3] = mBytesPerPixel == 4 ? src[3] : 255;
+			if (bytesPerPixel == 1) dst[0] = rgba[3];
+			else if (bytesPerPixel == 2) dst[0] = rgba[0], dst[1] = rgba[3];
+			else memcpy(dst, rgba, bytesPerPixel);
 		}
+	}
 	return res;
 }
 
 TextureImage TextureImage::enlarge(int scale) const {
 	TextureImage res(mWidth * scale, mHeight * scale, mBytesPerPixel);
-	for (int i = 0; i < mHeight * scale; i++)
-		for (int j = 0; j < mWidth * scale; j++)
-			for (int k = 0; k < mBytesPerPixel; k++) {
-				res.mData[i * res.mPitch + j * res.mBytesPerPixel + k] = mData[i / scale * mPitch + j / scale * mBytesPerPixel + k];
-			}
+	for (int i = 0; i < mHeight; i++) {
+		unsigned char* dst = res.mData + size_t(i) * scale * res.mPitch;
+		ImageKernels::enlargeRow(mData + size_t(i) * mPitch, dst, mWidth, mBytesPerPixel, scale);
+		for (int i1 = 1; i1 < scale; i1++) memcpy(dst + size_t(i1) * res.mPitch, dst, res.mWidth * mBytesPerPixel);
+	}
 	return res;
 }
 
 TextureImage TextureImage::shrink(int scale) const {
 	TextureImage res(mWidth / scale, mHeight / scale, mBytesPerPixel);
+	if (scale == 2) {
+		for (int i = 0; i < res.mHeight; i++)
+			ImageKernels::shrink2(mData + size_t(i) * 2 * mPitch, mData + size_t(i * 2 + 1) * mPitch, res.mData + size_t(i) * res.mPitch, res.mWidth, mBytesPerPixel);
+		return res;
+	}
 	for (int i = 0; i < mHeight / scale; i++)
 		for (int j = 0; j < mWidth / scale; j++)
 			for (int k = 0; k < mBytesPerPixel; k++) {
@@ -153,45 +199,316 @@ TextureImage TextureImage::shrink(int scale) const {
 	return res;
 }
 
-TextureImage TextureImage::resample(int width, int height) const {
-	TextureImage res(width, height, mBytesPerPixel);
-	for (int i = 0; i < height; i++)
-		for (int j = 0; j < width; j++)
-			for (int k = 0; k < mBytesPerPixel; k++) {
-				// TODO: use AABB to calculate an average color on destination area
-				int i1 = int(double(i) / height * mHeight), j1 = int(double(j) / width * mWidth);
-				res.mData[i * res.mPitch + j * res.mBytesPerPixel + k] = empty()? 0 : mData[i1 * mPitch + j1 * mBytesPerPixel + k];
+namespace {
+	constexpr int WeightBits = 14;
+
+	// Fixed point filter weights of each destination pixel along one axis (`taps` per pixel, zero padded)
+	struct Contributions {
+		int taps = 0;
+		std::vector<int> first, weights;
+	};
+
+	double sinc(double x) {
+		if (x == 0.0) return 1.0;
+		x *= 3.14159265358979323846;
+		return std::sin(x) / x;
+	}
+
+	double filterWeight(TextureImage::Filter filter, double x) {
+		x = std::abs(x);
+		if (filter == TextureImage::FilterBilinear) return std::max(0.0, 1.0 - x);
+		return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0; // Lanczos (a = 3)
+	}
+
+	Contributions contributions(int srcSize, int dstSize, TextureImage::Filter filter) {
+		Contributions res;
+		double scale = double(srcSize) / dstSize;
+		// Filters are stretched when downscaling
+		double radius = filter == TextureImage::FilterBilinear ? 1.0 : 3.0;
+		radius *= std::max(scale, 1.0);
+		if (filter == TextureImage::FilterNearest) res.taps = 1;
+		else if (filter == TextureImage::FilterBox) res.taps = int(std::ceil(scale)) + 1;
+		else res.taps = int(std::ceil(radius)) * 2 + 1;
+		res.taps = std::min(res.taps, srcSize);
+		res.first.resize(dstSize);
+		res.weights.assign(size_t(dstSize) * res.taps, 0);
+
+		std::vector<double> weights(res.taps + 3);
+		for (int i = 0; i < dstSize; i++) {
+			int first, last;
+			if (filter == TextureImage::FilterNearest) {
+				first = last = std::min(int(i * scale), srcSize - 1);
+				weights[0] = 1.0;
+			} else if (filter == TextureImage::FilterBox) {
+				// Overlap of source pixels with the destination pixel area
+				double lo = i * scale, hi = (i + 1) * scale;
+				first = int(lo), last = std::min(int(std::ceil(hi)), srcSize) - 1;
+				for (int j = first; j <= last; j++) weights[j - first] = std::min(hi, j + 1.0) - std::max(lo, double(j));
+			} else {
+				double center = (i + 0.5) * scale;
+				first = std::max(int(std::floor(center - radius)), 0);
+				last = std::min(int(std::ceil(center + radius)), srcSize - 1);
+				for (int j = first; j <= last; j++) weights[j - first] = filterWeight(filter, (j + 0.5 - center) / std::max(scale, 1.0));
+			}
+			// Drop zero taps at the ends
+			while (last > first && weights[last - first] == 0.0) last--;
+			while (first < last && weights[0] == 0.0) {
+				weights.erase(weights.begin());
+				weights.push_back(0.0);
+				first++;
+			}
+			Assert(last - first < res.taps);
+
+			// Normalize, rounding error goes to the largest weight
+			double sum = 0.0;
+			for (int j = first; j <= last; j++) sum += weights[j - first];
+			int* dst = &res.weights[size_t(i) * res.taps];
+			int total = 0, largest = 0;
+			for (int j = 0; j <= last - first; j++) {
+				dst[j] = int(std::lround(weights[j] / sum * (1 << WeightBits)));
+				total += dst[j];
+				if (dst[j] > dst[largest]) largest = j;
+			}
+			dst[largest] += (1 << WeightBits) - total;
+			res.first[i] = first;
+		}
+		return res;
+	}
+
+	inline unsigned char clampWeighted(int sum) {
+		sum = (sum + (1 << (WeightBits - 1))) >> WeightBits;
+		return static_cast<unsigned char>(std::min(std::max(sum, 0), 255));
+	}
+
+	template <int BytesPerPixel>
+	void resampleRow(const unsigned char* src, unsigned char* dst, int width, const Contributions& c) {
+		for (int x = 0; x < width; x++, dst += BytesPerPixel) {
+			const int* w = &c.weights[size_t(x) * c.taps];
+			const unsigned char* p = src + c.first[x] * BytesPerPixel;
+			int sum[BytesPerPixel] = {};
+			for (int k = 0; k < c.taps; k++, p += BytesPerPixel)
+				for (int ch = 0; ch < BytesPerPixel; ch++) sum[ch] += w[k] * p[ch];
+			for (int ch = 0; ch < BytesPerPixel; ch++) dst[ch] = clampWeighted(sum[ch]);
+		}
+	}
+
+	void resampleRow(const unsigned char* src, unsigned char* dst, int width, int bytesPerPixel, const Contributions& c) {
+		if (bytesPerPixel == 4) resampleRow<4>(src, dst, width, c);
+		else if (bytesPerPixel == 3) resampleRow<3>(src, dst, width, c);
+		else if (bytesPerPixel == 2) resampleRow<2>(src, dst, width, c);
+		else if (bytesPerPixel == 1) resampleRow<1>(src, dst, width, c);
+		else Assert(false, "Unsupported pixel size");
+	}
+
+	// Horizontal pass, rows in parallel
+	void resampleHorizontal(const TextureImage& src, TextureImage& dst, TextureImage::Filter filter) {
+		Contributions c = contributions(src.width(), dst.width(), filter);
+		ThreadPool::parallelFor(src.height(), 16, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				resampleRow(&src.color(0, i, 0), &dst.color(0, i, 0), dst.width(), src.bytesPerPixel(), c);
+		});
+	}
+
+	// Vertical pass, destination rows in parallel (whole rows at a time, which vectorizes well)
+	void resampleVertical(const TextureImage& src, TextureImage& dst, TextureImage::Filter filter) {
+		Contributions c = contributions(src.height(), dst.height(), filter);
+		int bytes = dst.width() * dst.bytesPerPixel();
+		ThreadPool::parallelFor(dst.height(), 16, [&](int begin, int end) {
+			std::vector<int> sums(bytes);
+			for (int i = begin; i < end; i++) {
+				std::fill(sums.begin(), sums.end(), 0);
+				const int* w = &c.weights[size_t(i) * c.taps];
+				for (int k = 0; k < c.taps; k++)
+					if (w[k] != 0) ImageKernels::accumulate(&src.color(0, c.first[i] + k, 0), sums.data(), bytes, w[k]);
+				unsigned char* row = &dst.color(0, i, 0);
+				for (int j = 0; j < bytes; j++) row[j] = clampWeighted(sums[j]);
 			}
+		});
+	}
+}
+
+TextureImage TextureImage::resample(int width, int height, Filter filter) const {
+	if (width == mWidth && height == mHeight && !empty()) return *this;
+	TextureImage res(width, height, mBytesPerPixel);
+	if (empty() || res.empty()) return res;
+	if (width == mWidth) resampleVertical(*this, res, filter);
+	else if (height == mHeight) resampleHorizontal(*this, res, filter);
+	else if (height < mHeight) {
+		// Reduce rows first, so that the horizontal pass runs on fewer of them
+		TextureImage tmp(mWidth, height, mBytesPerPixel);
+		resampleVertical(*this, tmp, filter);
+		resampleHorizontal(tmp, res, filter);
+	} else {
+		TextureImage tmp(width, mHeight, mBytesPerPixel);
+		resampleHorizontal(*this, tmp, filter);
+		resampleVertical(tmp, res, filter);
+	}
 	return res;
 }
 
-void Build2DMipmaps(const TextureImage& image, TextureFormat format, int level) {
+void Texture::setup(int levels, bool bilinear, bool keepStorage) {
+	// Immutable storage cannot be specified again: replaced by a new texture (with another ID)
+	if (mImmutable && !keepStorage) glDeleteTextures(1, &mID), mID = 0, mImmutable = false;
+	if (mID == 0) glGenTextures(1, &mID);
+	glBindTexture(GL_TEXTURE_2D, mID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, bilinear ? GL_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, bilinear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, levels - 1);
 	glTexEnvf(GL_TEXTURE_FILTER_CONTROL, GL_TEXTURE_LOD_BIAS, 0.0f);
-	Assert(image.bytesPerPixel() == 3 || image.bytesPerPixel() == 4);
-	TextureFormat srcFormat = image.bytesPerPixel() == 4 ? TextureFormatRGBA : TextureFormatRGB;
-	TextureImage curr;
-	curr = image;
-	for (int i = 0; i <= level; i++) {
-		glTexImage2D(GL_TEXTURE_2D, i, format, curr.width(), curr.height(), 0, srcFormat, GL_UNSIGNED_BYTE, curr.data());
-		curr = curr.shrink(2);
+}
+
+TextureImage Texture::expand(const TextureImage& image, bool alpha) {
+	TextureImage res(image.width(), image.height(), 4);
+	int bpp = image.bytesPerPixel();
+	bool mask = bpp == 1 && alpha;
+	for (int i = 0; i < image.height(); i++) {
+		const unsigned char* src = image.data() + size_t(i) * image.pitch();
+		unsigned char* dst = &res.color(0, i, 0);
+		for (int j = 0; j < image.width(); j++, src += bpp, dst += 4) {
+			dst[0] = dst[1] = dst[2] = mask ? 255 : src[0];
+			dst[3] = mask ? src[0] : (bpp == 2 && alpha ? src[1] : 255);
+		}
+	}
+	return res;
+}
+
+void Texture::formats(int bytesPerPixel, bool alpha, TextureFormat& internalFormat, TextureFormat& format) {
+	if (bytesPerPixel >= 3 || expandNeeded(bytesPerPixel)) {
+		internalFormat = alpha ? TextureFormatRGBA : TextureFormatRGB;
+		format = bytesPerPixel == 3 ? TextureFormatRGB : TextureFormatRGBA;
+	} else if (channelFormatsSupported()) {
+		internalFormat = bytesPerPixel == 1 ? GL_R8 : GL_RG8;
+		format = bytesPerPixel == 1 ? GL_RED : GL_RG;
+	} else {
+		// Legacy formats read the same without swizzling
+		if (bytesPerPixel == 1) internalFormat = alpha ? GL_ALPHA8 : GL_LUMINANCE8, format = alpha ? GL_ALPHA : GL_LUMINANCE;
+		else internalFormat = alpha ? GL_LUMINANCE8_ALPHA8 : GL_LUMINANCE8, format = GL_LUMINANCE_ALPHA;
+	}
+}
+
+void Texture::swizzle(int bytesPerPixel, bool alpha) {
+	if (!swizzleSupported()) return;
+	GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+	if (bytesPerPixel < 3 && channelFormatsSupported()) {
+		swizzle[0] = swizzle[1] = swizzle[2] = GL_RED;
+		swizzle[3] = bytesPerPixel == 2 && alpha ? GL_GREEN : GL_ONE;
+		if (bytesPerPixel == 1 && alpha) swizzle[0] = swizzle[1] = swizzle[2] = GL_ONE, swizzle[3] = GL_RED;
+	}
+	for (int i = 0; i < 4; i++) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R + i, swizzle[i]);
+}
+
+void Texture::create(const MipChain& chain, bool alpha, bool bilinear, bool upload) {
+	Assert(chain.bytesPerPixel() >= 1 && chain.bytesPerPixel() <= 4);
+	setup(chain.levels(), bilinear);
+	TextureFormat format, srcFormat;
+	formats(chain.bytesPerPixel(), alpha, format, srcFormat);
+	swizzle(chain.bytesPerPixel(), alpha);
+	bool expanding = expandNeeded(chain.bytesPerPixel());
+	for (int i = 0; i < chain.levels(); i++) {
+		const unsigned char* data = upload ? chain.data(i) : nullptr;
+		TextureImage expanded;
+		if (expanding && upload) expanded = expand(chain.level(i), alpha), data = expanded.data();
+		glTexImage2D(GL_TEXTURE_2D, i, format, chain.width(i), chain.height(i), 0, srcFormat, GL_UNSIGNED_BYTE, data);
 	}
 }
 
-void Texture::load(const TextureImage& image, bool alpha, bool bilinear, int maxLevels) {
+void Texture::create(int width, int height, int bytesPerPixel, bool alpha, bool bilinear, int levels) {
+	setup(levels, bilinear);
+	TextureFormat format, srcFormat;
+	formats(bytesPerPixel, alpha, format, srcFormat);
+	swizzle(bytesPerPixel, alpha);
+	for (int i = 0; i < levels; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, format, std::max(width >> i, 1), std::max(height >> i, 1), 0, srcFormat, GL_UNSIGNED_BYTE, nullptr);
+}
+
+void Texture::upload(const MipChain& chain, int x, int y, bool alpha) {
+	Assert(mID != 0);
+	TextureFormat format, srcFormat;
+	formats(chain.bytesPerPixel(), alpha, format, srcFormat);
+	bind();
+	for (int i = 0; i < chain.levels(); i++) {
+		const unsigned char* data = chain.data(i);
+		TextureImage expanded;
+		if (expandNeeded(chain.bytesPerPixel())) expanded = expand(chain.level(i), alpha), data = expanded.data();
+		glTexSubImage2D(GL_TEXTURE_2D, i, x >> i, y >> i, chain.width(i), chain.height(i), srcFormat, GL_UNSIGNED_BYTE, data);
+	}
+	unbind();
+}
+
+void Texture::createStreamed(int levels, bool bilinear) {
+	setup(levels, bilinear);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+}
+
+void Texture::setBaseLevel(int level) {
+	bind();
+	// Level of detail limits are relative to the base level, so they stay as they are
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+void Texture::generate(const TextureImage& image, bool alpha, bool bilinear, int levels) {
+	// Storage of more levels than down to 1x1 is an error
+	levels = std::min(levels, MipChain::fullLevels(image.width(), image.height()));
+	TextureFormat format, srcFormat;
+	formats(image.bytesPerPixel(), alpha, format, srcFormat);
+	// Immutable storage of the same size, format & levels is reused, which keeps the ID
+	bool reuse = false;
+	if (mImmutable && storageSupported()) {
+		bind();
+		GLint width = 0, height = 0, internalFormat = 0, maxLevel = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		reuse = width == image.width() && height == image.height() && GLenum(internalFormat) == sizedFormat(format) && maxLevel == levels - 1;
+	}
+	setup(levels, bilinear, reuse);
+	swizzle(image.bytesPerPixel(), alpha);
+	if (storageSupported()) {
+		if (!reuse) glTexStorage2D(GL_TEXTURE_2D, levels, sizedFormat(format), image.width(), image.height());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(), srcFormat, GL_UNSIGNED_BYTE, image.data());
+		mImmutable = true;
+	} else {
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width(), image.height(), 0, srcFormat, GL_UNSIGNED_BYTE, image.data());
+	}
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+Texture::MipmapStrategy Texture::defaultMipmapStrategy() {
+	// CPU by default. Benchmark::mipmapGeneration() on Mesa 22.3.6 llvmpipe (1 core), 2048x2048 RGBA:
+	// CPU 4.9 ms, GPU with immutable storage 29.0 ms. Hardware drivers may favor the GPU, hence the option.
+	static const MipmapStrategy res = Config::getInt("OpenGL.MipmapGeneration", 0) == 1 ? MipmapGPU : MipmapCPU;
+	return res;
+}
+
+void Texture::load(const TextureImage& image, bool alpha, bool bilinear, int maxLevels, MipmapStrategy strategy) {
 	if (image.data() == nullptr) {
 		LogWarning("Skipping empty texture image");
 		return;
 	}
-	Assert(image.bytesPerPixel() == 3 || image.bytesPerPixel() == 4);
-	if (maxLevels < 0) maxLevels = int(log2(image.width()));
-	TextureFormat format = alpha ? TextureFormatRGBA : TextureFormatRGB;
-	glGenTextures(1, &mID);
-	glBindTexture(GL_TEXTURE_2D, mID);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, bilinear ? GL_LINEAR : GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, bilinear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_LINEAR);
-	Build2DMipmaps(image, format, maxLevels);
+	if (maxLevels < 0) maxLevels = MipChain::fullLevels(image.width(), image.height()) - 1;
+	if (strategy == MipmapDefault) strategy = defaultMipmapStrategy();
+	// Box filter of the driver, in stored (not linear) color space
+	if (strategy == MipmapGPU && maxLevels > 0 && generateMipmapSupported() && !expandNeeded(image.bytesPerPixel())) {
+		// Rows are uploaded as 4-byte aligned
+		generate(image.compact() ? image : image.clone(), alpha, bilinear, maxLevels + 1);
+		return;
+	}
+	static const bool gammaCorrect = Config::getInt("OpenGL.GammaCorrectMipmaps", 0) != 0;
+	create(MipChain(image, maxLevels + 1, gammaCorrect), alpha, bilinear);
+}
+
+const Texture& Texture::placeholder() {
+	// Never destroyed, as the OpenGL context may be gone at exit
+	static const Texture* res = nullptr;
+	if (res == nullptr) {
+		TextureImage image(2, 2, 4);
+		for (int i = 0; i < 2; i++) for (int j = 0; j < 2; j++) for (int k = 0; k < 4; k++)
+			image.color(j, i, k) = k == 3 ? 255 : ((i + j) % 2 == 0 ? 96 : 160);
+		res = new Texture(image, true, false);
+	}
+	return *res;
 }
@@ -3,38 +3,42 @@
 
 #include <string>
 #include <cstring>
+#include <memory>
 #include "logger.h"
 #include "opengl.h"
 
-// RGB/RGBA texture image, pixels aligned
+struct SDL_Surface;
+
+// Texture image of 1 (gray or mask), 2 (gray & alpha), 3 (RGB) or 4 (RGBA) bytes per pixel, rows aligned.
+// Copies and views share pixel storage, which is copied on the first write through a shared image (see color()).
 class TextureImage {
 public:
 	TextureImage() = default;
-	TextureImage(int width, int height, int bytesPerPixel):
-		mWidth(width), mHeight(height), mBytesPerPixel(bytesPerPixel), mPitch(alignedPitch(mWidth * bytesPerPixel)),
-		mData(new unsigned char[mHeight * mPitch]) {
-		memset(mData, 0, mHeight * mPitch * sizeof(unsigned char));
-	}
-	TextureImage(TextureImage&& r) noexcept:
-		mWidth(r.mWidth), mHeight(r.mHeight), mBytesPerPixel(r.mBytesPerPixel), mPitch(r.mPitch) {
-		std::swap(mData, r.mData);
+	TextureImage(int width, int height, int bytesPerPixel) {
+		allocate(width, height, bytesPerPixel);
+		memset(mData, 0, size_t(mHeight) * mPitch * sizeof(unsigned char));
 	}
+	TextureImage(const TextureImage& r) = default;
+	TextureImage(TextureImage&& r) noexcept { swap(r); }
 	TextureImage(const std::string& filename) { loadFromPNG(filename); }
-	~TextureImage() { if (mData != nullptr) delete[] mData; }
 
-	TextureImage& operator= (const TextureImage& r) {
-		if (mData != nullptr) delete[] mData;
-		mHeight = r.mHeight, mWidth = r.mWidth, mPitch = r.mPitch, mBytesPerPixel = r.mBytesPerPixel;
-		mData = new unsigned char[mHeight * mPitch];
-		memcpy(mData, r.mData, mHeight * mPitch * sizeof(unsigned char));
+	TextureImage& operator= (const TextureImage& r) = default;
+	TextureImage& operator= (TextureImage&& r) noexcept {
+		TextureImage(std::move(r)).swap(*this);
 		return (*this);
 	}
 
 	void loadFromBMP(const std::string& filename, bool checkSize = false, bool masked = false);
 	void loadFromPNG(const std::string& filename, bool checkSize = false, bool masked = false);
+	// Take over the pixels of an RGB24/RGBA32 surface with matching pitch (freed with the image), returns false otherwise
+	bool adopt(SDL_Surface* surface);
 	
-	unsigned char& color(int x, int y, int c) { return mData[y * mPitch + x * mBytesPerPixel + c]; }
-	const unsigned char& color(int x, int y, int c) const { return mData[y * mPitch + x * mBytesPerPixel + c]; }
+	// Writable pixel, makes the storage unique first
+	unsigned char& color(int x, int y, int c) {
+		detach();
+		return mData[size_t(y) * mPitch + x * mBytesPerPixel + c];
+	}
+	const unsigned char& color(int x, int y, int c) const { return mData[size_t(y) * mPitch + x * mBytesPerPixel + c]; }
 
 	int width() const { return mWidth; }
 	int height() const { return mHeight; }
@@ -42,13 +46,24 @@ public:
 	int bytesPerPixel() const { return mBytesPerPixel; }
 	bool empty() const { return mWidth == 0 || mHeight == 0 || mBytesPerPixel == 0; }
 	const unsigned char* data() const { return mData; }
+	// Whether rows are exactly alignedPitch() bytes apart (not true for most views)
+	bool compact() const { return mPitch == alignedPitch(mWidth * mBytesPerPixel); }
+
+	// Image with its own copy of the pixels
+	TextureImage clone() const;
+	// Rectangle sharing the pixels of this image (clipped to it)
+	TextureImage view(int x, int y, int width, int height) const;
 
 	void copyFrom(const TextureImage& src, int x, int y, int srcx = 0, int srcy = 0);
 
+	// Change pixel size (single channel pixels are masks: white with alpha, two channels are gray & alpha)
 	TextureImage convert(int bytesPerPixel) const;
 	TextureImage enlarge(int scale) const;
 	TextureImage shrink(int scale) const;
-	TextureImage resample(int width, int height) const;
+	// Resampling filters
+	enum Filter { FilterNearest, FilterBox, FilterBilinear, FilterLanczos };
+	// Separable resampling (box: average over the destination pixel area), parallelized by row bands
+	TextureImage resample(int width, int height, Filter filter = FilterBox) const;
 
 	static int alignedPitch(int pitch, int align = 4) {
 		if (pitch % align == 0) return pitch;
@@ -56,32 +71,107 @@ public:
 	}
 
 private:
+	friend class MipChain;
+
 	int mWidth = 0, mHeight = 0, mBytesPerPixel = 0, mPitch = 0;
+	// Shared storage & first pixel of this image within it
+	std::shared_ptr<unsigned char> mStorage;
 	unsigned char* mData = nullptr;
+
+	// Image of pixels in existing storage
+	TextureImage(std::shared_ptr<unsigned char> storage, unsigned char* data, int width, int height, int bytesPerPixel, int pitch):
+		mWidth(width), mHeight(height), mBytesPerPixel(bytesPerPixel), mPitch(pitch), mStorage(std::move(storage)), mData(data) {}
+
+	// Replace contents with new uninitialized storage
+	void allocate(int width, int height, int bytesPerPixel);
+	// Copy shared storage before writing
+	void detach() { if (mStorage.use_count() > 1) *this = clone(); }
+	void swap(TextureImage& r) noexcept {
+		std::swap(mWidth, r.mWidth), std::swap(mHeight, r.mHeight), std::swap(mBytesPerPixel, r.mBytesPerPixel);
+		std::swap(mPitch, r.mPitch), std::swap(mStorage, r.mStorage), std::swap(mData, r.mData);
+	}
 };
 
+class MipChain;
+
 class Texture {
 public:
+	// Where load() computes mip levels: MipChain on the CPU, or glGenerateMipmap on immutable storage
+	enum MipmapStrategy { MipmapDefault, MipmapCPU, MipmapGPU };
+
 	Texture() = default;
-	Texture(Texture&& r) = default;
+	Texture(Texture&& r) noexcept { std::swap(mID, r.mID), std::swap(mImmutable, r.mImmutable); }
 	Texture(const TextureImage& image, bool alpha = false, bool bilinear = true, int maxLevels = 0) {
 		load(image, alpha, bilinear, maxLevels);
 	}
 	~Texture() { if (mID > 0) glDeleteTextures(1, &mID); }
 
-	void load(const TextureImage& image, bool alpha = false, bool bilinear = true, int maxLevels = 0);
+	Texture& operator=(Texture&& r) noexcept {
+		std::swap(mID, r.mID), std::swap(mImmutable, r.mImmutable);
+		return *this;
+	}
+
+	// Loading into a texture with immutable storage (see MipmapGPU) creates a new texture, so id() changes,
+	// unless it is loaded with MipmapGPU again at the same size, format & number of levels.
+	void load(const TextureImage& image, bool alpha = false, bool bilinear = true, int maxLevels = 0, MipmapStrategy strategy = MipmapDefault);
+	// Create texture with all levels of the chain, contents uploaded only when `upload` is set
+	void create(const MipChain& chain, bool alpha = false, bool bilinear = true, bool upload = true);
+	// Create texture of `levels` levels with undefined contents, for pixels of the given size
+	void create(int width, int height, int bytesPerPixel, bool alpha = false, bool bilinear = true, int levels = 1);
+	// Upload the levels of a chain into the rectangle at (x, y) of the base level, each one at (x >> level, y >> level).
+	// The texture must have as many levels (created for the same pixel size & `alpha`), x & y must be multiples of 2 ^ (levels - 1).
+	void upload(const MipChain& chain, int x, int y, bool alpha);
+	// Create texture without levels, which are then specified & uploaded one by one from the coarsest one
+	void createStreamed(int levels, bool bilinear = true);
+	// Sample levels from `level` on only (finer ones are not loaded)
+	void setBaseLevel(int level);
 	TextureID id() const { return mID; }
 	void bind() const { glBindTexture(GL_TEXTURE_2D, mID); }
 	static void unbind() { glBindTexture(GL_TEXTURE_2D, 0); }
 
+	// Neutral texture to show while the real one is loading
+	static const Texture& placeholder();
+
 	static int maxSize() {
 		GLint res;
 		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &res);
 		return res;
 	}
+	// Strategy used by default ("OpenGL.MipmapGeneration": 0 = CPU, 1 = GPU)
+	static MipmapStrategy defaultMipmapStrategy();
+	// glGenerateMipmap is available (the CPU is used otherwise)
+	static bool generateMipmapSupported() { return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object; }
+	// glTexStorage2D is available
+	static bool storageSupported() { return GLEW_VERSION_4_2 || GLEW_ARB_texture_storage; }
+	// Images of 1 & 2 bytes per pixel are stored as R8/RG8 and swizzled. Otherwise legacy alpha & luminance
+	// formats are used, or they are expanded to RGBA in core profiles (see expandNeeded()).
+	static bool channelFormatsSupported() { return (GLEW_VERSION_3_0 || GLEW_ARB_texture_rg) && swizzleSupported(); }
+	static bool swizzleSupported() { return GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle || GLEW_EXT_texture_swizzle; }
+	// Whether images of pixels of the given size must be expanded to RGBA (see expand()) before uploading
+	static bool expandNeeded(int bytesPerPixel) { return bytesPerPixel < 3 && !channelFormatsSupported() && OpenGL::coreProfile(); }
+	// Single & dual channel image as RGBA, read like the swizzled formats would
+	static TextureImage expand(const TextureImage& image, bool alpha);
+	// Formats for pixels of the given size. Single channel ones read as a mask (1, 1, 1, R) with `alpha`,
+	// as gray (R, R, R, 1) without, dual channel ones as gray & alpha (R, R, R, G) (opaque without `alpha`).
+	static void formats(int bytesPerPixel, bool alpha, TextureFormat& internalFormat, TextureFormat& format);
+	// Set up swizzling of the bound texture for the formats above (all four channels, identity if not needed)
+	static void swizzle(int bytesPerPixel, bool alpha);
 
 private:
 	TextureID mID = 0;
+	// Storage allocated by glTexStorage2D, which cannot be specified again
+	bool mImmutable = false;
+
+	// Upload base level & generate the others on the GPU
+	void generate(const TextureImage& image, bool alpha, bool bilinear, int levels);
+
+	// Sized equivalent of an unsized internal format (required by glTexStorage2D)
+	static TextureFormat sizedFormat(TextureFormat format) {
+		return format == TextureFormatRGBA ? GL_RGBA8 : (format == TextureFormatRGB ? GL_RGB8 : format);
+	}
+	// Generate & bind texture, set up filtering for the given number of levels.
+	// Immutable storage is deleted (with the texture name) unless `keepStorage` is set.
+	void setup(int levels, bool bilinear, bool keepStorage = false);
 };
 
 #endif
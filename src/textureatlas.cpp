@@ -0,0 +1,153 @@
+#include "textureatlas.h"
+#include <algorithm>
+#include <cstring>
+#include "debug.h"
+#include "logger.h"
+#include "config.h"
+#include "mipchain.h"
+
+constexpr float TextureAtlas::RepackThreshold;
+
+TextureAtlas::TextureAtlas(int width, int height, int mipLevels, bool bilinear):
+	mImage(width, height, 4), mMipLevels(std::max(mipLevels, 1)), mBilinear(bilinear) {
+	// Level n averages 2^n x 2^n blocks: aligned regions with as much padding never share a texel there
+	mMipLevels = std::min(mMipLevels, MipChain::fullLevels(width, height));
+	mPadding = 1 << (mMipLevels - 1);
+	mSkyline.push_back({ 0, 0, width });
+	mDirty.push_back({ 0, 0, width, height });
+}
+
+int TextureAtlas::paddedSize(int size) const {
+	size += mPadding * 2;
+	return (size + mPadding - 1) / mPadding * mPadding;
+}
+
+bool TextureAtlas::allocate(int width, int height, int& x, int& y) {
+	// Bottom-left: lowest position, then leftmost
+	int best = -1, bestY = 0;
+	for (size_t i = 0; i < mSkyline.size(); i++) {
+		int left = mSkyline[i].x, top = 0;
+		if (left + width > mImage.width()) break;
+		for (size_t j = i; j < mSkyline.size() && mSkyline[j].x < left + width; j++) top = std::max(top, mSkyline[j].y);
+		if (top + height > mImage.height()) continue;
+		if (best < 0 || top < bestY) best = int(i), bestY = top;
+	}
+	if (best < 0) return false;
+	x = mSkyline[best].x, y = bestY;
+
+	// Raise the skyline under the new rectangle
+	Segment added = { x, y + height, width };
+	auto it = mSkyline.begin() + best;
+	while (it != mSkyline.end() && it->x < x + width) {
+		int end = it->x + it->width;
+		if (end <= x + width) it = mSkyline.erase(it);
+		else {
+			it->width = end - (x + width), it->x = x + width;
+			break;
+		}
+	}
+	it = mSkyline.insert(it, added);
+	// Merge neighbors of the same height
+	for (size_t i = 0; i + 1 < mSkyline.size();) {
+		if (mSkyline[i].y == mSkyline[i + 1].y) {
+			mSkyline[i].width += mSkyline[i + 1].width;
+			mSkyline.erase(mSkyline.begin() + i + 1);
+		} else i++;
+	}
+	return true;
+}
+
+void TextureAtlas::blit(const TextureImage& image, const Region& region) {
+	for (int i = -mPadding; i < region.height + mPadding; i++) {
+		int srcY = std::min(std::max(i, 0), region.height - 1);
+		unsigned char* dst = &mImage.color(region.x, region.y + i, 0);
+		const unsigned char* src = &image.color(0, srcY, 0);
+		memcpy(dst, src, size_t(region.width) * 4);
+		for (int j = 1; j <= mPadding; j++) {
+			memcpy(dst - j * 4, src, 4);
+			memcpy(dst + (region.width + j - 1) * 4, src + (region.width - 1) * 4, 4);
+		}
+	}
+	mDirty.push_back({ region.x - mPadding, region.y - mPadding, paddedSize(region.width), paddedSize(region.height) });
+}
+
+int TextureAtlas::insert(const TextureImage& image) {
+	if (image.bytesPerPixel() != 4) return insert(image.convert(4));
+	int width = paddedSize(image.width()), height = paddedSize(image.height()), x, y;
+	if (!allocate(width, height, x, y)) {
+		if (fragmentation() < RepackThreshold) {
+			LogWarning("Texture atlas is full");
+			return -1;
+		}
+		repack();
+		if (!allocate(width, height, x, y)) {
+			LogWarning("Texture atlas is full");
+			return -1;
+		}
+	}
+	Region region = { x + mPadding, y + mPadding, image.width(), image.height() };
+	blit(image, region);
+	mPackedArea += (long long)width * height;
+	mRegions[mNextID] = region;
+	return mNextID++;
+}
+
+void TextureAtlas::remove(int id) {
+	mRegions.erase(id);
+}
+
+UVRect TextureAtlas::uvRect(int id) const {
+	auto it = mRegions.find(id);
+	Assert(it != mRegions.end(), "Invalid texture atlas region");
+	const Region& r = it->second;
+	UVRect res;
+	res.u0 = float(r.x) / width(), res.v0 = float(r.y) / height();
+	res.u1 = float(r.x + r.width) / width(), res.v1 = float(r.y + r.height) / height();
+	return res;
+}
+
+float TextureAtlas::fragmentation() const {
+	if (mPackedArea == 0) return 0.0f;
+	long long live = 0;
+	for (const auto& curr: mRegions) live += (long long)paddedSize(curr.second.width) * paddedSize(curr.second.height);
+	return 1.0f - float(double(live) / double(mPackedArea));
+}
+
+void TextureAtlas::repack() {
+	// Keep views of live images (the old pixels stay alive with them), then insert them again from the tallest one
+	std::vector<std::pair<int, TextureImage>> images;
+	for (const auto& curr: mRegions) {
+		const Region& r = curr.second;
+		images.emplace_back(curr.first, mImage.view(r.x, r.y, r.width, r.height));
+	}
+	std::sort(images.begin(), images.end(), [](const std::pair<int, TextureImage>& a, const std::pair<int, TextureImage>& b) {
+		return a.second.height() > b.second.height();
+	});
+	mImage = TextureImage(mImage.width(), mImage.height(), 4);
+	mSkyline.assign(1, { 0, 0, mImage.width() });
+	mRegions.clear();
+	mPackedArea = 0;
+	for (const auto& curr: images) {
+		int width = paddedSize(curr.second.width()), height = paddedSize(curr.second.height()), x, y;
+		if (!allocate(width, height, x, y)) {
+			LogWarning("Texture atlas region lost while repacking");
+			continue;
+		}
+		Region region = { x + mPadding, y + mPadding, curr.second.width(), curr.second.height() };
+		blit(curr.second, region);
+		mPackedArea += (long long)width * height;
+		mRegions[curr.first] = region;
+	}
+	mDirty.assign(1, { 0, 0, mImage.width(), mImage.height() });
+}
+
+void TextureAtlas::update() {
+	if (mDirty.empty()) return;
+	if (mTexture.id() == 0) mTexture.create(mImage.width(), mImage.height(), 4, true, mBilinear, mMipLevels);
+	static const bool gammaCorrect = Config::getInt("OpenGL.GammaCorrectMipmaps", 0) != 0;
+	// Padded rectangles are aligned to 2 ^ (levels - 1), their levels are the same as those of the whole image
+	for (const Region& r: mDirty) {
+		mTexture.upload(MipChain(mImage.view(r.x, r.y, r.width, r.height), mMipLevels, gammaCorrect), r.x, r.y, true);
+	}
+	mDirty.clear();
+}
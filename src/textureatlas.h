@@ -0,0 +1,70 @@
+#ifndef TEXTUREATLAS_H_
+#define TEXTUREATLAS_H_
+
+#include <vector>
+#include <map>
+#include "texture.h"
+
+// Texture coordinates of a sub-rectangle
+struct UVRect {
+	float u0 = 0.0f, v0 = 0.0f, u1 = 1.0f, v1 = 1.0f;
+};
+
+// Packs small images into one texture (skyline packer), so that they can be drawn with a single bind.
+// Regions are aligned & padded with repeated edge pixels so that mip levels do not bleed into each other.
+class TextureAtlas {
+public:
+	TextureAtlas(int width, int height, int mipLevels = 3, bool bilinear = true);
+
+	// Add image, returns region ID (-1 when it does not fit even after repacking)
+	int insert(const TextureImage& image);
+	// Free region (its area is reclaimed when the atlas gets repacked)
+	void remove(int id);
+	// Texture coordinates of region (change when the atlas is repacked)
+	UVRect uvRect(int id) const;
+	// Upload changed rectangles (all levels of them) into the texture, which keeps its ID
+	void update();
+	const Texture& texture() const { return mTexture; }
+
+	// Part of the packed area not used by live regions
+	float fragmentation() const;
+	// Move all live regions into a fresh layout
+	void repack();
+
+	int width() const { return mImage.width(); }
+	int height() const { return mImage.height(); }
+
+private:
+	// Repack on insertion failure when at least this much of the packed area is unused
+	static constexpr float RepackThreshold = 0.25f;
+
+	struct Region {
+		// Image rectangle, excluding padding
+		int x, y, width, height;
+	};
+	// Skyline segment: [x, x + width) is filled up to y
+	struct Segment {
+		int x, y, width;
+	};
+
+	TextureImage mImage;
+	Texture mTexture;
+	int mMipLevels, mPadding;
+	bool mBilinear;
+	// Padded rectangles changed since the last update (the whole image when the texture is created or repacked)
+	std::vector<Region> mDirty;
+	std::vector<Segment> mSkyline;
+	std::map<int, Region> mRegions;
+	int mNextID = 0;
+	// Area of all packed rectangles (including removed ones), with padding
+	long long mPackedArea = 0;
+
+	// Find place for a padded rectangle, returns false when full
+	bool allocate(int width, int height, int& x, int& y);
+	// Copy image into place, repeating edge pixels into the padding
+	void blit(const TextureImage& image, const Region& region);
+	// Padded size of a region
+	int paddedSize(int size) const;
+};
+
+#endif // !TEXTUREATLAS_H_
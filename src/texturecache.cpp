@@ -0,0 +1,174 @@
+#include "texturecache.h"
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <sys/stat.h>
+#include "config.h"
+#include "logger.h"
+
+struct TextureCacheEntry {
+	std::string filename;
+	bool alpha = false, bilinear = true;
+	int maxLevels = 0, width = 0, height = 0;
+	// Load options as part of cache keys
+	std::string options;
+	// Current load (empty while evicted)
+	TextureHandle handle;
+	// Entry with identical contents used instead (its load is released), and whether contents were compared yet
+	std::shared_ptr<TextureCacheEntry> merged;
+	bool compared = false;
+	// Frame of last use
+	unsigned long long lastUsed = 0;
+};
+
+namespace {
+	// Path with '/' separators, without "." segments & repeated separators
+	std::string normalize(const std::string& path) {
+		std::string res;
+		size_t begin = 0;
+		while (begin < path.size()) {
+			size_t end = std::min(path.find_first_of("/\\", begin), path.size());
+			std::string segment = path.substr(begin, end - begin);
+			begin = end + 1;
+			if (segment.empty() || segment == ".") continue;
+			if (!res.empty()) res += '/';
+			res += segment;
+		}
+		return !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" + res : res;
+	}
+}
+
+bool CachedTexture::ready() const { return mEntry != nullptr && (mEntry->merged != nullptr ? mEntry->merged : mEntry)->handle.ready(); }
+bool CachedTexture::failed() const { return mEntry != nullptr && (mEntry->merged != nullptr ? mEntry->merged : mEntry)->handle.failed(); }
+
+const Texture& CachedTexture::texture() const {
+	if (mEntry == nullptr) return Texture::placeholder();
+	return TextureCache::use(*this).handle.texture();
+}
+
+const Texture& CachedTexture::texture(float width, float height) const {
+	if (mEntry == nullptr) return Texture::placeholder();
+	return TextureCache::use(*this).handle.texture(width, height);
+}
+
+std::map<std::string, std::weak_ptr<TextureCacheEntry>> TextureCache::mEntries, TextureCache::mContents;
+size_t TextureCache::mBudget = 0, TextureCache::mResidentBytes = 0;
+unsigned long long TextureCache::mFrame = 0;
+bool TextureCache::mOverBudget = false;
+
+void TextureCache::init() {
+	mBudget = size_t(std::max(Config::getInt("TextureCache.BudgetMB", 512), 0)) * 1024 * 1024;
+	mFrame = 0;
+}
+
+void TextureCache::destroy() {
+	// Entries die with their last reference
+	mEntries.clear();
+	mContents.clear();
+	mResidentBytes = 0;
+}
+
+CachedTexture TextureCache::load(const std::string& filename, bool alpha, bool bilinear, int maxLevels, int width, int height) {
+	CachedTexture res;
+	std::stringstream options;
+	options << alpha << " " << bilinear << " " << maxLevels << " " << width << "x" << height;
+	// Cheap to tell apart on the main thread: contents are only read by the loader
+	struct stat info;
+	std::stringstream key;
+	key << normalize(filename) << "|" << options.str();
+	if (stat(filename.c_str(), &info) == 0) key << "|" << info.st_size << "|" << info.st_mtime;
+	res.mEntry = mEntries[key.str()].lock();
+	if (res.mEntry != nullptr) return res;
+
+	res.mEntry = std::make_shared<TextureCacheEntry>();
+	TextureCacheEntry& entry = *res.mEntry;
+	entry.filename = filename;
+	entry.alpha = alpha, entry.bilinear = bilinear;
+	entry.maxLevels = maxLevels, entry.width = width, entry.height = height;
+	entry.options = options.str();
+	entry.lastUsed = mFrame;
+	entry.handle = TextureLoader::load(filename, alpha, bilinear, maxLevels, width, height);
+	mEntries[key.str()] = res.mEntry;
+	return res;
+}
+
+TextureCacheEntry& TextureCache::use(const CachedTexture& texture) {
+	TextureCacheEntry& entry = texture.mEntry->merged != nullptr ? *texture.mEntry->merged : *texture.mEntry;
+	entry.lastUsed = mFrame;
+	if (!entry.handle.valid())
+		entry.handle = TextureLoader::load(entry.filename, entry.alpha, entry.bilinear, entry.maxLevels, entry.width, entry.height);
+	return entry;
+}
+
+void TextureCache::merge() {
+	for (const auto& curr: mEntries) {
+		std::shared_ptr<TextureCacheEntry> entry = curr.second.lock();
+		if (entry == nullptr || entry->compared || entry->merged != nullptr || entry->handle.contentHash() == 0) continue;
+		entry->compared = true;
+		std::stringstream ss;
+		ss << std::hex << std::setw(16) << std::setfill('0') << entry->handle.contentHash() << "|" << entry->options;
+		std::shared_ptr<TextureCacheEntry> existing = mContents[ss.str()].lock();
+		if (existing == nullptr || existing == entry) {
+			mContents[ss.str()] = entry;
+			continue;
+		}
+		// Same contents under another name: keep the earlier load
+		existing->lastUsed = std::max(existing->lastUsed, entry->lastUsed);
+		entry->merged = existing;
+		entry->handle = TextureHandle();
+	}
+}
+
+void TextureCache::prune(std::map<std::string, std::weak_ptr<TextureCacheEntry>>& entries) {
+	for (auto it = entries.begin(); it != entries.end();) {
+		if (it->second.expired()) it = entries.erase(it);
+		else it++;
+	}
+}
+
+void TextureCache::update() {
+	prune(mEntries);
+	prune(mContents);
+	merge();
+
+	// Entries still loading are not counted. Failed ones are, to be evicted like the others.
+	std::vector<std::shared_ptr<TextureCacheEntry>> resident;
+	mResidentBytes = 0;
+	for (const auto& curr: mEntries) {
+		std::shared_ptr<TextureCacheEntry> entry = curr.second.lock();
+		if (entry == nullptr || entry->merged != nullptr || (!entry->handle.ready() && !entry->handle.failed())) continue;
+		mResidentBytes += entry->handle.bytes();
+		resident.push_back(entry);
+	}
+
+	// Failed loads hold no video memory, but are retried only once evicted
+	for (auto& entry: resident) {
+		if (entry->handle.failed() && entry->lastUsed + 1 < mFrame) entry->handle = TextureHandle();
+	}
+
+	if (mBudget > 0 && mResidentBytes > mBudget) {
+		std::sort(resident.begin(), resident.end(), [](const std::shared_ptr<TextureCacheEntry>& a, const std::shared_ptr<TextureCacheEntry>& b) {
+			return a->lastUsed < b->lastUsed;
+		});
+		// Levels finer than needed go first, even from textures in use
+		for (const auto& entry: resident) {
+			if (mResidentBytes <= mBudget) break;
+			mResidentBytes -= entry->handle.dropLevels();
+		}
+		for (const auto& entry: resident) {
+			if (mResidentBytes <= mBudget) break;
+			// Textures drawn in the previous frame are needed again
+			if (entry->lastUsed + 1 >= mFrame) break;
+			mResidentBytes -= entry->handle.bytes();
+			entry->handle = TextureHandle();
+		}
+		if (mResidentBytes > mBudget && !mOverBudget) {
+			std::stringstream ss;
+			ss << "Textures in use exceed the video memory budget (" << mResidentBytes / (1024 * 1024) << " MB)";
+			LogWarning(ss.str());
+		}
+	}
+	mOverBudget = mBudget > 0 && mResidentBytes > mBudget;
+	mFrame++;
+}
@@ -0,0 +1,65 @@
+#ifndef TEXTURECACHE_H_
+#define TEXTURECACHE_H_
+
+#include <string>
+#include <memory>
+#include <map>
+#include "textureloader.h"
+
+struct TextureCacheEntry;
+
+// Shared reference to a texture of the TextureCache. The texture is released with its last reference.
+class CachedTexture {
+public:
+	CachedTexture() = default;
+
+	bool valid() const { return mEntry != nullptr; }
+	bool ready() const;
+	bool failed() const;
+	// Texture to draw (the placeholder while loading), marks it as used in this frame.
+	// Evicted textures are loaded again.
+	const Texture& texture() const;
+	// Same, drawn at `width` x `height` pixels (only the levels needed for that are loaded)
+	const Texture& texture(float width, float height) const;
+
+private:
+	friend class TextureCache;
+	std::shared_ptr<TextureCacheEntry> mEntry;
+};
+
+// Loads each texture once per file & options, keeps track of video memory. Files are told apart by path, size
+// & modification time; entries for files with identical contents are merged once loaded (hashed on loader threads).
+// When over "TextureCache.BudgetMB" (0 = unlimited), levels finer than textures are drawn at are dropped,
+// then textures not used for the longest time are evicted.
+class TextureCache {
+public:
+	static void init();
+	static void destroy();
+
+	// Shared texture for file & options (see TextureLoader::load())
+	static CachedTexture load(const std::string& filename, bool alpha = false, bool bilinear = true, int maxLevels = 0,
+							  int width = 0, int height = 0);
+	// Account memory & evict. Call once per frame, after TextureLoader::update().
+	static void update();
+
+	// Video memory used by textures currently loaded
+	static size_t residentBytes() { return mResidentBytes; }
+
+private:
+	friend class CachedTexture;
+
+	// Entries by file & options / by contents & options
+	static std::map<std::string, std::weak_ptr<TextureCacheEntry>> mEntries, mContents;
+	static size_t mBudget, mResidentBytes;
+	static unsigned long long mFrame;
+	static bool mOverBudget;
+
+	// Entry marked as used (the one merged into, for identical contents), loaded again if evicted
+	static TextureCacheEntry& use(const CachedTexture& texture);
+	// Merge entries whose contents turned out identical
+	static void merge();
+	// Remove keys of released entries
+	static void prune(std::map<std::string, std::weak_ptr<TextureCacheEntry>>& entries);
+};
+
+#endif // !TEXTURECACHE_H_
@@ -0,0 +1,110 @@
+#include "texturecontainer.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include "config.h"
+#include "logger.h"
+#include "texture.h"
+#include "mipchain.h"
+
+constexpr const char* TextureContainer::Extension;
+
+namespace {
+	// File layout: header, level table, then level data (16-byte aligned)
+	const uint32_t Magic = 0x58455443; // "CTEX"
+	const uint32_t Version = 1;
+	const size_t DataAlignment = 16;
+
+	struct Header {
+		uint32_t magic, version, bytesPerPixel, levels;
+	};
+	struct LevelEntry {
+		uint32_t width, height, pitch, reserved;
+		uint64_t offset;
+	};
+
+	size_t alignUp(size_t offset) { return (offset + DataAlignment - 1) / DataAlignment * DataAlignment; }
+}
+
+bool TextureContainer::write(const std::string& filename, const MipChain& chain) {
+	Header header = { Magic, Version, uint32_t(chain.bytesPerPixel()), uint32_t(chain.levels()) };
+	std::vector<LevelEntry> table(chain.levels());
+	size_t offset = alignUp(sizeof(Header) + sizeof(LevelEntry) * table.size());
+	for (int i = 0; i < chain.levels(); i++) {
+		int pitch = TextureImage::alignedPitch(chain.width(i) * chain.bytesPerPixel());
+		table[i] = { uint32_t(chain.width(i)), uint32_t(chain.height(i)), uint32_t(pitch), 0, offset };
+		offset = alignUp(offset + size_t(pitch) * chain.height(i));
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(table.data()), std::streamsize(sizeof(LevelEntry) * table.size()));
+	std::vector<char> padding(DataAlignment, 0), row;
+	for (int i = 0; i < chain.levels(); i++) {
+		size_t pos = size_t(out.tellp());
+		out.write(padding.data(), std::streamsize(table[i].offset - pos));
+		row.assign(table[i].pitch, 0);
+		for (int y = 0; y < chain.height(i); y++) {
+			memcpy(row.data(), chain.data(i) + size_t(y) * chain.pitch(i), size_t(chain.width(i)) * chain.bytesPerPixel());
+			out.write(row.data(), std::streamsize(row.size()));
+		}
+	}
+	return bool(out);
+}
+
+bool TextureContainer::cook(const std::string& source, const std::string& filename, int maxLevels) {
+	TextureImage image;
+	std::string ext = source.substr(std::min(source.rfind('.'), source.size()));
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+	if (ext == ".bmp") image.loadFromBMP(source);
+	else image.loadFromPNG(source);
+	if (image.empty()) return false;
+	bool gammaCorrect = Config::getInt("OpenGL.GammaCorrectMipmaps", 0) != 0;
+	if (!write(filename, MipChain(image, maxLevels, gammaCorrect))) {
+		LogWarning("Failed to write cooked texture \"" + filename + "\"");
+		return false;
+	}
+	LogInfo("Cooked \"" + source + "\" into \"" + filename + "\"");
+	return true;
+}
+
+bool TextureContainer::open(const std::string& filename) {
+	close();
+	if (!mFile.open(filename)) return false;
+	const unsigned char* data = mFile.data();
+	size_t size = mFile.size();
+
+	Header header;
+	if (size < sizeof(Header)) {
+		close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(Header));
+	if (header.magic != Magic || header.version != Version || header.bytesPerPixel == 0 || header.bytesPerPixel > 4 ||
+		header.levels == 0 || header.levels > 32 || size < sizeof(Header) + sizeof(LevelEntry) * header.levels) {
+		close();
+		return false;
+	}
+	mBytesPerPixel = int(header.bytesPerPixel);
+	for (uint32_t i = 0; i < header.levels; i++) {
+		LevelEntry entry;
+		memcpy(&entry, data + sizeof(Header) + sizeof(LevelEntry) * i, sizeof(LevelEntry));
+		// Rows are uploaded straight from the mapping with the default unpack alignment, so the pitch must match it
+		if (entry.width == 0 || entry.height == 0 || entry.width > 1u << 16 ||
+			entry.pitch != uint32_t(TextureImage::alignedPitch(int(entry.width * header.bytesPerPixel))) ||
+			entry.offset > size || uint64_t(entry.pitch) * entry.height > size - entry.offset) {
+			close();
+			return false;
+		}
+		mLevels.push_back({ int(entry.width), int(entry.height), int(entry.pitch), size_t(entry.offset) });
+	}
+	return true;
+}
+
+void TextureContainer::close() {
+	mFile.close();
+	mBytesPerPixel = 0;
+	mLevels.clear();
+}
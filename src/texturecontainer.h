@@ -0,0 +1,46 @@
+#ifndef TEXTURECONTAINER_H_
+#define TEXTURECONTAINER_H_
+
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+
+class MipChain;
+
+// Cooked texture file: a complete mip chain of 1-4 bytes per pixel (see TextureImage) with rows laid out for uploading as-is
+// (4-byte aligned, like TextureImage). Opened by memory mapping, level data points into the mapped file.
+class TextureContainer {
+public:
+	// File name extension of cooked textures
+	static constexpr const char* Extension = ".ctex";
+
+	TextureContainer() = default;
+
+	// Write all levels of the chain
+	static bool write(const std::string& filename, const MipChain& chain);
+	// Decode PNG/BMP image, build its mip chain ("OpenGL.GammaCorrectMipmaps") and write it
+	static bool cook(const std::string& source, const std::string& filename, int maxLevels = -1);
+
+	bool open(const std::string& filename);
+	void close();
+
+	bool empty() const { return mLevels.empty(); }
+	int bytesPerPixel() const { return mBytesPerPixel; }
+	int levels() const { return int(mLevels.size()); }
+	int width(int level) const { return mLevels[level].width; }
+	int height(int level) const { return mLevels[level].height; }
+	int pitch(int level) const { return mLevels[level].pitch; }
+	const unsigned char* data(int level) const { return mFile.data() + mLevels[level].offset; }
+
+private:
+	struct Level {
+		int width, height, pitch;
+		size_t offset;
+	};
+
+	int mBytesPerPixel = 0;
+	std::vector<Level> mLevels;
+	MappedFile mFile;
+};
+
+#endif // !TEXTURECONTAINER_H_
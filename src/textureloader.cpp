@@ -0,0 +1,400 @@
+#include "textureloader.h"
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include "config.h"
+#include "logger.h"
+#include "mipchain.h"
+#include "compressedimage.h"
+#include "texturecontainer.h"
+#include "updatescheduler.h"
+
+struct TextureLoadRequest {
+	enum State { Queued, Decoded, Uploading, Ready, Failed };
+
+	std::atomic<int> state{ Queued };
+	std::string filename;
+	bool alpha = false, bilinear = true;
+	int maxLevels = 0, width = 0, height = 0;
+	// Decoded image & its mip chain, released once the levels needed are uploaded
+	std::unique_ptr<TextureImage> image;
+	std::unique_ptr<MipChain> chain;
+	// Block-compressed levels (replace the above when texture compression is enabled)
+	std::unique_ptr<CompressedImage> compressed;
+	// Mapped cooked texture (replaces all of the above)
+	std::unique_ptr<TextureContainer> container;
+	// Hash of the file contents (see CompressedImage::hashFile()), 0 until first decoded
+	uint64_t contentHash = 0;
+	// Pixel size of decoded images & cooked textures (see Texture::formats()), 0 for block-compressed ones
+	int bytesPerPixel = 0;
+	Texture texture;
+	// Size & video memory of each level (known once first decoded)
+	struct Level {
+		int width, height;
+		size_t bytes;
+	};
+	std::vector<Level> levels;
+	// Finest level uploaded (levels.size() when none) & video memory used by uploaded levels
+	int base = 0;
+	size_t bytes = 0;
+	// Next rows to upload
+	int level = 0, row = 0;
+	// Largest size drawn at in the frame of the last draw (0 when not given: all levels are needed)
+	float footprintWidth = 0.0f, footprintHeight = 0.0f;
+	unsigned long long footprintFrame = 0;
+};
+
+namespace {
+	// Alpha of the texture: single channel files are gray (masks are not loaded here), so opaque
+	bool textureAlpha(const TextureLoadRequest& request) { return request.alpha && request.bytesPerPixel != 1; }
+}
+
+// Main thread only: usable as soon as the coarsest level is uploaded
+bool TextureHandle::ready() const { return mRequest != nullptr && mRequest->base < int(mRequest->levels.size()); }
+bool TextureHandle::failed() const { return mRequest != nullptr && mRequest->state == TextureLoadRequest::Failed; }
+const Texture& TextureHandle::texture() const { return ready() ? mRequest->texture : Texture::placeholder(); }
+size_t TextureHandle::bytes() const { return ready() ? mRequest->bytes : 0; }
+uint64_t TextureHandle::contentHash() const { return ready() ? mRequest->contentHash : 0; }
+
+const Texture& TextureHandle::texture(float width, float height) const {
+	if (mRequest == nullptr) return Texture::placeholder();
+	TextureLoadRequest& request = *mRequest;
+	if (request.footprintFrame != TextureLoader::mFrame) {
+		request.footprintWidth = width, request.footprintHeight = height;
+		request.footprintFrame = TextureLoader::mFrame;
+	} else {
+		request.footprintWidth = std::max(request.footprintWidth, width);
+		request.footprintHeight = std::max(request.footprintHeight, height);
+	}
+	// Decode again for finer levels
+	if (request.state == TextureLoadRequest::Ready && TextureLoader::neededLevel(request) < request.base) {
+		request.state = TextureLoadRequest::Queued;
+		TextureLoader::queue(mRequest);
+	}
+	return texture();
+}
+
+size_t TextureHandle::dropLevels() {
+	if (mRequest == nullptr || mRequest->state != TextureLoadRequest::Ready) return 0;
+	TextureLoadRequest& request = *mRequest;
+	int needed = TextureLoader::neededLevel(request);
+	if (request.base >= needed) return 0;
+	size_t res = 0;
+	request.texture.setBaseLevel(needed);
+	for (; request.base < needed; request.base++) {
+		// Respecified as empty, which frees its memory
+		glTexImage2D(GL_TEXTURE_2D, request.base, TextureFormatRGBA, 0, 0, 0, TextureFormatRGBA, GL_UNSIGNED_BYTE, nullptr);
+		res += request.levels[request.base].bytes;
+	}
+	Texture::unbind();
+	request.bytes -= res;
+	return res;
+}
+
+std::vector<std::thread> TextureLoader::mThreads;
+std::mutex TextureLoader::mMutex;
+std::condition_variable TextureLoader::mWake;
+bool TextureLoader::mQuit = false;
+std::deque<std::shared_ptr<TextureLoadRequest>> TextureLoader::mQueued, TextureLoader::mDecoded, TextureLoader::mReleased;
+double TextureLoader::mBudget = 0.0;
+bool TextureLoader::mGammaCorrect = false;
+bool TextureLoader::mCompression = false;
+VertexBufferID TextureLoader::mPBO = 0;
+unsigned long long TextureLoader::mFrame = 0;
+
+void TextureLoader::init() {
+	if (!mThreads.empty()) return;
+	mBudget = Config::getDouble("TextureLoader.UploadBudget", 2.0) / 1000.0;
+	mGammaCorrect = Config::getInt("OpenGL.GammaCorrectMipmaps", 0) != 0;
+	mCompression = Config::getInt("OpenGL.TextureCompression", 0) != 0 && CompressedImage::supported();
+	int threads = std::max(Config::getInt("TextureLoader.Threads", 2), 1);
+	if (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) glGenBuffers(1, &mPBO);
+	mQuit = false;
+	for (int i = 0; i < threads; i++) mThreads.emplace_back(worker);
+	std::stringstream ss;
+	ss << "Texture loader: " << threads << " threads, " << (mPBO != 0 ? "pixel buffer uploads" : "direct uploads");
+	if (mCompression) ss << ", S3TC compression";
+	LogInfo(ss.str());
+}
+
+void TextureLoader::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (auto& curr: mThreads) curr.join();
+	mThreads.clear();
+	mQueued.clear();
+	mDecoded.clear();
+	mReleased.clear();
+	if (mPBO != 0) glDeleteBuffers(1, &mPBO);
+	mPBO = 0;
+}
+
+TextureHandle TextureLoader::load(const std::string& filename, bool alpha, bool bilinear, int maxLevels, int width, int height) {
+	TextureHandle res;
+	res.mRequest = std::make_shared<TextureLoadRequest>();
+	TextureLoadRequest& request = *res.mRequest;
+	request.filename = filename;
+	request.alpha = alpha, request.bilinear = bilinear;
+	request.maxLevels = maxLevels, request.width = width, request.height = height;
+	queue(res.mRequest);
+	return res;
+}
+
+void TextureLoader::queue(const std::shared_ptr<TextureLoadRequest>& request) {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueued.push_back(request);
+	}
+	mWake.notify_one();
+}
+
+int TextureLoader::neededLevel(const TextureLoadRequest& request) {
+	if (request.footprintWidth <= 0.0f || request.footprintHeight <= 0.0f) return 0;
+	// Coarsest level still covering a texel per pixel
+	int res = 0;
+	while (res + 1 < int(request.levels.size()) && request.levels[res + 1].width >= request.footprintWidth &&
+		   request.levels[res + 1].height >= request.footprintHeight) res++;
+	return res;
+}
+
+int TextureLoader::pending() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return int(mQueued.size() + mDecoded.size());
+}
+
+void TextureLoader::worker() {
+	while (true) {
+		std::shared_ptr<TextureLoadRequest> request;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, []() { return mQuit || !mQueued.empty(); });
+			if (mQuit) return;
+			request = mQueued.front();
+			mQueued.pop_front();
+		}
+		// Skip requests whose handles are all gone
+		if (request.use_count() > 1) {
+			decode(*request);
+			// Finer levels could not be decoded again, keep the ones uploaded
+			if (request->state == TextureLoadRequest::Failed && !request->levels.empty()) request->state = TextureLoadRequest::Ready;
+		}
+		// Never the last reference here: handles may be released meanwhile, and the texture of a request decoded
+		// again for finer levels must be deleted on the main thread (see update())
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (request->state == TextureLoadRequest::Decoded) mDecoded.push_back(std::move(request));
+		else mReleased.push_back(std::move(request));
+	}
+}
+
+void TextureLoader::decode(TextureLoadRequest& request) {
+	std::string ext = request.filename.substr(std::min(request.filename.rfind('.'), request.filename.size()));
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+
+	// Read once per request, on the loader thread
+	if (request.contentHash == 0 && !CompressedImage::hashFile(request.filename, request.contentHash)) {
+		LogWarning("Failed to load file \"" + request.filename + "\"");
+		request.state = TextureLoadRequest::Failed;
+		return;
+	}
+
+	// Cooked textures are used as they are
+	if (ext == TextureContainer::Extension) {
+		std::unique_ptr<TextureContainer> container(new TextureContainer());
+		if (!container->open(request.filename) || Texture::expandNeeded(container->bytesPerPixel())) {
+			LogWarning("Failed to load file \"" + request.filename + "\" as cooked texture");
+			request.state = TextureLoadRequest::Failed;
+			return;
+		}
+		request.bytesPerPixel = container->bytesPerPixel();
+		request.container = std::move(container);
+		request.state = TextureLoadRequest::Decoded;
+		return;
+	}
+
+	// Previously compressed images are taken from the cache without decoding
+	std::string cache;
+	if (mCompression) {
+		std::stringstream options;
+		options << (request.alpha ? "BC3" : "BC1") << " " << request.maxLevels << " " << request.width << "x" << request.height << " " << mGammaCorrect;
+		cache = CompressedImage::cacheFilename(request.contentHash, options.str());
+		std::unique_ptr<CompressedImage> compressed(new CompressedImage());
+		if (compressed->load(cache)) {
+			request.bytesPerPixel = 0;
+			request.compressed = std::move(compressed);
+			request.state = TextureLoadRequest::Decoded;
+			return;
+		}
+	}
+
+	std::unique_ptr<TextureImage> image(new TextureImage());
+	if (ext == ".bmp") image->loadFromBMP(request.filename);
+	else image->loadFromPNG(request.filename);
+	if (image->empty()) {
+		request.state = TextureLoadRequest::Failed;
+		return;
+	}
+	if (request.width > 0 && request.height > 0 && (request.width != image->width() || request.height != image->height()))
+		*image = image->resample(request.width, request.height);
+	request.bytesPerPixel = image->bytesPerPixel();
+	bool alpha = textureAlpha(request);
+	if (Texture::expandNeeded(image->bytesPerPixel())) {
+		*image = Texture::expand(*image, alpha);
+		request.bytesPerPixel = 4;
+	}
+	int levels = request.maxLevels < 0 ? -1 : request.maxLevels + 1;
+	request.chain.reset(new MipChain(*image, levels, mGammaCorrect));
+	request.image = std::move(image);
+	if (mCompression) {
+		// The format is stored in the cache file, gray images are opaque whatever its key says
+		request.compressed.reset(new CompressedImage(*request.chain, alpha ? CompressedImage::FormatBC3 : CompressedImage::FormatBC1));
+		request.bytesPerPixel = 0;
+		if (!request.compressed->save(cache)) LogWarning("Failed to write texture cache file \"" + cache + "\"");
+		request.chain.reset();
+		request.image.reset();
+	}
+	request.state = TextureLoadRequest::Decoded;
+}
+
+bool TextureLoader::uploadChunk(TextureLoadRequest& request) {
+	// Bytes per glTexSubImage2D call
+	const int ChunkBytes = 256 * 1024;
+	const CompressedImage* compressed = request.compressed.get();
+	const TextureContainer* container = request.container.get();
+	int width, height, rows, bytesPerPixel = 0;
+	size_t bytes;
+	const unsigned char* src;
+	if (compressed != nullptr) {
+		// Whole rows of 4x4 blocks
+		width = compressed->width(request.level), height = compressed->height(request.level);
+		int pitch = compressed->pitch(request.level);
+		rows = std::min(std::max(ChunkBytes / pitch, 1) * 4, height - request.row);
+		bytes = size_t((rows + 3) / 4) * pitch;
+		src = compressed->data(request.level) + size_t(request.row / 4) * pitch;
+	} else if (container != nullptr) {
+		width = container->width(request.level), height = container->height(request.level);
+		int pitch = container->pitch(request.level);
+		rows = std::min(std::max(ChunkBytes / pitch, 1), height - request.row);
+		bytes = size_t(rows) * pitch;
+		src = container->data(request.level) + size_t(request.row) * pitch;
+		bytesPerPixel = container->bytesPerPixel();
+	} else {
+		const MipChain& chain = *request.chain;
+		width = chain.width(request.level), height = chain.height(request.level);
+		int pitch = chain.pitch(request.level);
+		rows = std::min(std::max(ChunkBytes / pitch, 1), height - request.row);
+		bytes = size_t(rows) * pitch;
+		src = chain.data(request.level) + size_t(request.row) * pitch;
+		bytesPerPixel = chain.bytesPerPixel();
+	}
+
+	request.texture.bind();
+	TextureFormat internalFormat = 0, format = 0;
+	if (compressed == nullptr) Texture::formats(bytesPerPixel, textureAlpha(request), internalFormat, format);
+	// Specify the level before its first rows (and before binding the pixel buffer, which would be read)
+	if (request.row == 0) {
+		if (compressed != nullptr) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, request.level, compressed->internalFormat(), width, height, 0,
+								   compressed->size(request.level), nullptr);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, request.level, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+		}
+	}
+	void* mapped = nullptr;
+	// Mapped pages are handed to the driver directly, copying them into a pixel buffer gains nothing
+	if (mPBO != 0 && container == nullptr) {
+		// Orphan & refill, the driver copies to the texture asynchronously
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPBO);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (mapped != nullptr) {
+			memcpy(mapped, src, bytes);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		} else glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	const void* pixels = mapped != nullptr ? nullptr : src;
+	if (compressed != nullptr) {
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, request.level, 0, request.row, width, rows, compressed->internalFormat(), GLsizei(bytes), pixels);
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, request.level, 0, request.row, width, rows, format, GL_UNSIGNED_BYTE, pixels);
+	}
+	if (mapped != nullptr) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	request.row += rows;
+	if (request.row == height) {
+		// Level complete, sample it from now on
+		request.base = request.level;
+		request.bytes += request.levels[request.level].bytes;
+		request.texture.setBaseLevel(request.base);
+		request.level--, request.row = 0;
+	}
+	return request.base <= neededLevel(request);
+}
+
+void TextureLoader::update() {
+	// Dropped here, with the OpenGL context current
+	std::deque<std::shared_ptr<TextureLoadRequest>> released;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		released.swap(mReleased);
+	}
+	released.clear();
+
+	double start = UpdateScheduler::timeFromEpoch();
+	bool uploaded = false;
+	do {
+		std::shared_ptr<TextureLoadRequest> request;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mDecoded.empty()) break;
+			request = mDecoded.front();
+			// Drop requests whose handles are all gone (queue & local reference left)
+			if (request.use_count() == 2) {
+				mDecoded.pop_front();
+				continue;
+			}
+		}
+		if (request->state == TextureLoadRequest::Decoded) {
+			// First decoded: create the texture without levels
+			if (request->levels.empty()) {
+				std::vector<TextureLoadRequest::Level>& levels = request->levels;
+				// Bytes per texel stored: single & dual channel formats keep their size
+				int bytesPerPixel = request->bytesPerPixel < 3 ? request->bytesPerPixel : (request->alpha ? 4 : 3);
+				if (request->compressed != nullptr) {
+					const CompressedImage& image = *request->compressed;
+					for (int i = 0; i < image.levels(); i++) levels.push_back({ image.width(i), image.height(i), size_t(image.size(i)) });
+				} else if (request->container != nullptr) {
+					const TextureContainer& container = *request->container;
+					for (int i = 0; i < container.levels(); i++)
+						levels.push_back({ container.width(i), container.height(i), size_t(container.width(i)) * container.height(i) * bytesPerPixel });
+				} else {
+					const MipChain& chain = *request->chain;
+					for (int i = 0; i < chain.levels(); i++)
+						levels.push_back({ chain.width(i), chain.height(i), size_t(chain.width(i)) * chain.height(i) * bytesPerPixel });
+				}
+				request->texture.createStreamed(int(levels.size()), request->bilinear);
+				if (request->compressed == nullptr) Texture::swizzle(request->bytesPerPixel, textureAlpha(*request));
+				request->base = int(levels.size());
+			}
+			request->level = request->base - 1, request->row = 0;
+			request->state = TextureLoadRequest::Uploading;
+		}
+		uploaded = true;
+		// Levels needed may have become fewer while decoding
+		if (request->base <= neededLevel(*request) || uploadChunk(*request)) {
+			request->chain.reset();
+			request->image.reset();
+			request->compressed.reset();
+			request->container.reset();
+			request->state = TextureLoadRequest::Ready;
+			std::lock_guard<std::mutex> lock(mMutex);
+			mDecoded.pop_front();
+		}
+	} while (UpdateScheduler::timeFromEpoch() - start < mBudget);
+	if (uploaded) Texture::unbind();
+	mFrame++;
+}
@@ -0,0 +1,91 @@
+#ifndef TEXTURELOADER_H_
+#define TEXTURELOADER_H_
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "texture.h"
+
+struct TextureLoadRequest;
+
+// Result of an asynchronous texture load
+class TextureHandle {
+public:
+	TextureHandle() = default;
+
+	bool valid() const { return mRequest != nullptr; }
+	// Uploaded and usable
+	bool ready() const;
+	// Loading failed (file missing or unsupported)
+	bool failed() const;
+	// Loaded texture, or the placeholder until it is ready
+	const Texture& texture() const;
+	// Same, drawn at `width` x `height` pixels: finer levels are streamed in only when that needs them
+	const Texture& texture(float width, float height) const;
+	// Video memory used by the levels uploaded (0 until ready)
+	size_t bytes() const;
+	// Hash of the file contents (0 until ready)
+	uint64_t contentHash() const;
+	// Release uploaded levels finer than the texture was last drawn at, returns bytes freed
+	size_t dropLevels();
+
+private:
+	friend class TextureLoader;
+	std::shared_ptr<TextureLoadRequest> mRequest;
+};
+
+// Decodes images and builds their mip chains on loader threads, then uploads them
+// on the main thread in time slices ("TextureLoader.UploadBudget" milliseconds per frame).
+// Levels are uploaded from the coarsest one, down to the finest one needed by the size textures are drawn at
+// (see TextureHandle::texture()). Decoded images are released then, and decoded again if finer levels are needed later.
+class TextureLoader {
+public:
+	// Start loader threads ("TextureLoader.Threads"). Must be called after OpenGL context is available!
+	static void init();
+	static void destroy();
+
+	// Queue image file (PNG, or BMP by extension), optionally resampled to the given size.
+	// Cooked textures (see TextureContainer) are mapped and uploaded as they are.
+	static TextureHandle load(const std::string& filename, bool alpha = false, bool bilinear = true, int maxLevels = 0,
+							  int width = 0, int height = 0);
+	// Upload decoded images within the time budget. Call once per frame.
+	static void update();
+
+	// Requests not uploaded yet
+	static int pending();
+
+private:
+	friend class TextureHandle;
+
+	static std::vector<std::thread> mThreads;
+	static std::mutex mMutex;
+	static std::condition_variable mWake;
+	static bool mQuit;
+	// Waiting for decoding / decoded and waiting for upload / done by loader threads, released on the main thread
+	static std::deque<std::shared_ptr<TextureLoadRequest>> mQueued, mDecoded, mReleased;
+	// Upload time per frame (seconds)
+	static double mBudget;
+	static bool mGammaCorrect;
+	// Encode to S3TC and cache results on disk ("OpenGL.TextureCompression")
+	static bool mCompression;
+	// Pixel buffer object for uploads (0 when unsupported)
+	static VertexBufferID mPBO;
+	// Frames updated so far
+	static unsigned long long mFrame;
+
+	static void worker();
+	// Queue request for decoding
+	static void queue(const std::shared_ptr<TextureLoadRequest>& request);
+	// Finest level needed for the size the texture is drawn at
+	static int neededLevel(const TextureLoadRequest& request);
+	static void decode(TextureLoadRequest& request);
+	// Upload next chunk of rows, returns whether the request is complete
+	static bool uploadChunk(TextureLoadRequest& request);
+};
+
+#endif // !TEXTURELOADER_H_
@@ -0,0 +1,87 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <sstream>
+#include "config.h"
+#include "logger.h"
+
+std::vector<std::thread> ThreadPool::mThreads;
+std::mutex ThreadPool::mMutex, ThreadPool::mJobMutex;
+std::condition_variable ThreadPool::mWake, ThreadPool::mDone;
+bool ThreadPool::mQuit = false;
+const std::function<void(int, int)>* ThreadPool::mJob = nullptr;
+int ThreadPool::mCount = 0, ThreadPool::mChunk = 0, ThreadPool::mActive = 0;
+std::atomic<int> ThreadPool::mNext(0);
+unsigned long long ThreadPool::mGeneration = 0;
+thread_local bool ThreadPool::mWorker = false;
+
+void ThreadPool::init() {
+	if (!mThreads.empty()) return;
+	int threads = Config::getInt("ThreadPool.Threads", 0);
+	if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+	mQuit = false;
+	for (int i = 1; i < threads; i++) mThreads.emplace_back(worker);
+	std::stringstream ss;
+	ss << "Thread pool: " << threadCount() << " threads";
+	LogInfo(ss.str());
+}
+
+void ThreadPool::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (auto& curr: mThreads) curr.join();
+	mThreads.clear();
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& f) {
+	if (count <= 0) return;
+	grain = std::max(grain, 1);
+	// One job at a time: when another thread's job holds the pool, run inline rather than wait behind it
+	std::unique_lock<std::mutex> job(mJobMutex, std::defer_lock);
+	if (mThreads.empty() || mWorker || count <= grain || !job.try_lock()) {
+		f(0, count);
+		return;
+	}
+
+	// A few chunks per thread to balance uneven work
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJob = &f;
+		mCount = count;
+		mChunk = std::max(grain, count / (threadCount() * 4));
+		mNext = 0;
+		mActive = int(mThreads.size());
+		mGeneration++;
+	}
+	mWake.notify_all();
+	runChunks();
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, []() { return mActive == 0; });
+	mJob = nullptr;
+}
+
+void ThreadPool::runChunks() {
+	while (true) {
+		int begin = mNext.fetch_add(mChunk);
+		if (begin >= mCount) break;
+		(*mJob)(begin, std::min(begin + mChunk, mCount));
+	}
+}
+
+void ThreadPool::worker() {
+	mWorker = true;
+	unsigned long long generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [&]() { return mQuit || mGeneration != generation; });
+			if (mQuit) return;
+			generation = mGeneration;
+		}
+		runChunks();
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mActive == 0) mDone.notify_one();
+	}
+}
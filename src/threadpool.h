@@ -0,0 +1,40 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Worker threads for data-parallel loops. The calling thread takes part in the work.
+class ThreadPool {
+public:
+	// Start workers ("ThreadPool.Threads", 0 = one per CPU core)
+	static void init();
+	static void destroy();
+
+	// Threads running a parallel loop, including the calling thread
+	static int threadCount() { return int(mThreads.size()) + 1; }
+	// Call f(begin, end) for chunks of at least `grain` items covering [0, count), returns when all are done.
+	// Runs inline when called from a worker, before init() or while the pool runs another thread's loop.
+	static void parallelFor(int count, int grain, const std::function<void(int, int)>& f);
+
+private:
+	static std::vector<std::thread> mThreads;
+	static std::mutex mMutex, mJobMutex;
+	static std::condition_variable mWake, mDone;
+	static bool mQuit;
+	// Current job
+	static const std::function<void(int, int)>* mJob;
+	static int mCount, mChunk, mActive;
+	static std::atomic<int> mNext;
+	static unsigned long long mGeneration;
+	static thread_local bool mWorker;
+
+	static void worker();
+	static void runChunks();
+};
+
+#endif // !THREADPOOL_H_
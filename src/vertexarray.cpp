@@ -1,144 +1,358 @@
 #include "vertexarray.h"
+#include <vector>
+#include <algorithm>
+#include "config.h"
+#include "meshoptimizer.h"
 
-void VertexBuffer::update(const VertexArray& va, bool staticDraw) {
-	vertexes = va.vertexCount();
-	format = va.format();
-	if (va.vertexCount() == 0) {
-		vertexes = id = 0;
+// Client states currently enabled (compatibility profile)
+static bool texCoordArrayEnabled = false;
+static bool colorArrayEnabled = false;
+static bool normalArrayEnabled = false;
+static bool vertexArrayEnabled = false;
+
+IndexBuffer IndexBuffer::mQuads;
+
+void IndexBuffer::update(const unsigned int* data, int indexes_, bool staticDraw) {
+	if (indexes_ == 0) {
+		destroy();
+		return;
+	}
+	indexes = indexes_;
+	if (!OpenGL::coreProfile()) {
+		if (id == 0) glGenBuffersARB(1, &id);
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, id);
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indexes * sizeof(unsigned int),
+						data, staticDraw ? GL_STATIC_DRAW_ARB : GL_STREAM_DRAW_ARB);
+	} else {
+		// The element array binding belongs to the bound vertex array object, which must keep its own
+		GLint vao = 0;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+		if (vao != 0) glBindVertexArray(0);
+		if (id == 0) glGenBuffers(1, &id);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexes * sizeof(unsigned int),
+					 data, staticDraw ? GL_STATIC_DRAW : GL_STREAM_DRAW);
+		if (vao != 0) glBindVertexArray(GLuint(vao));
+	}
+}
+
+void IndexBuffer::bind() const {
+	if (!OpenGL::coreProfile()) glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, id);
+	else glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+}
+
+void IndexBuffer::destroy() {
+	if (empty()) return;
+	if (!OpenGL::coreProfile()) glDeleteBuffersARB(1, &id);
+	else glDeleteBuffers(1, &id);
+	id = indexes = 0;
+}
+
+const IndexBuffer& IndexBuffer::quads(int count) {
+	if (mQuads.indexes >= count * 6) return mQuads;
+	// Grow geometrically so that a few larger arrays do not cause an upload each
+	count = std::max(std::max(count, mQuads.indexes / 6 * 2), 256);
+	std::vector<unsigned int> data(count * 6);
+	for (int i = 0; i < count; i++) {
+		unsigned int* p = &data[i * 6], base = i * 4;
+		p[0] = base, p[1] = base + 1, p[2] = base + 2;
+		p[3] = base + 2, p[4] = base + 1, p[5] = base + 3;
+	}
+	mQuads.update(data.data(), count * 6, true);
+	return mQuads;
+}
+
+void IndexBuffer::releaseQuads() {
+	mQuads.destroy();
+}
+
+constexpr GLuint InstanceBuffer::AttribLocation;
+constexpr int InstanceBuffer::AttribCount;
+
+void InstanceBuffer::update(const InstanceAttributes* data, int instances_, bool staticDraw) {
+	if (instances_ == 0) {
+		destroy();
+		return;
+	}
+	instances = instances_;
+	if (!supported()) {
+		mFallback.assign(data, data + instances);
 		return;
 	}
 	if (!OpenGL::coreProfile()) {
 		if (id == 0) glGenBuffersARB(1, &id);
 		glBindBufferARB(GL_ARRAY_BUFFER_ARB, id);
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, va.vertexCount() * sizeof(float) * format.vertexAttributeCount,
-						va.data(), staticDraw ? GL_STATIC_DRAW_ARB : GL_STREAM_DRAW_ARB);
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, instances * sizeof(InstanceAttributes),
+						data, staticDraw ? GL_STATIC_DRAW_ARB : GL_STREAM_DRAW_ARB);
 	} else {
-		if (id == 0) {
-			Assert(vao == 0);
-			glGenVertexArrays(1, &vao);
-			glGenBuffers(1, &id);
-		}
-		glBindVertexArray(vao);
+		if (id == 0) glGenBuffers(1, &id);
 		glBindBuffer(GL_ARRAY_BUFFER, id);
-		glBufferData(GL_ARRAY_BUFFER, va.vertexCount() * sizeof(float) * format.vertexAttributeCount,
-					 va.data(), staticDraw ? GL_STATIC_DRAW : GL_STREAM_DRAW);
-		int cnt = 0;
-		if (format.textureCount != 0) {
-			glVertexAttribPointer(
-				cnt, format.textureCount, GL_FLOAT, GL_FALSE,
-				format.vertexAttributeCount * sizeof(float),
-				nullptr
-			);
-			glEnableVertexAttribArray(cnt++);
-		}
-		if (format.colorCount != 0) {
-			glVertexAttribPointer(
-				cnt, format.colorCount, GL_FLOAT, GL_FALSE,
-				format.vertexAttributeCount * sizeof(float),
-				reinterpret_cast<float*>(format.textureCount * sizeof(float))
-			);
-			glEnableVertexAttribArray(cnt++);
-		}
-		if (format.normalCount != 0) {
-			glVertexAttribPointer(
-				cnt, format.normalCount, GL_FLOAT, GL_FALSE,
-				format.vertexAttributeCount * sizeof(float),
-				reinterpret_cast<float*>((format.textureCount + format.colorCount) * sizeof(float))
-			);
-			glEnableVertexAttribArray(cnt++);
-		}
-		if (format.coordinateCount != 0) {
-			glVertexAttribPointer(
-				cnt, format.coordinateCount, GL_FLOAT, GL_FALSE,
-				format.vertexAttributeCount * sizeof(float),
-				reinterpret_cast<float*>((format.textureCount + format.colorCount + format.normalCount) * sizeof(float))
-			);
-			glEnableVertexAttribArray(cnt++);
-		}
+		glBufferData(GL_ARRAY_BUFFER, instances * sizeof(InstanceAttributes),
+					 data, staticDraw ? GL_STATIC_DRAW : GL_STREAM_DRAW);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
 	}
 }
 
-VertexBuffer::VertexBuffer(const VertexArray& va, bool staticDraw):
-	id(0), vao(0), vertexes(va.vertexCount()), format(va.format()) {
-	update(va, staticDraw);
+void InstanceBuffer::destroy() {
+	if (id != 0) {
+		if (!OpenGL::coreProfile()) glDeleteBuffersARB(1, &id);
+		else glDeleteBuffers(1, &id);
+	}
+	mFallback.clear();
+	id = instances = 0;
 }
 
-void VertexBuffer::render() const {
-	if (id == 0) return;
+void InstanceBuffer::bind() const {
+	if (!OpenGL::coreProfile()) glBindBufferARB(GL_ARRAY_BUFFER_ARB, id);
+	else glBindBuffer(GL_ARRAY_BUFFER, id);
+	for (int i = 0; i < AttribCount; i++) {
+		glVertexAttribPointer(
+			AttribLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes),
+			reinterpret_cast<void*>(i * 4 * sizeof(float))
+		);
+		glEnableVertexAttribArray(AttribLocation + i);
+		if (!OpenGL::coreProfile()) glVertexAttribDivisorARB(AttribLocation + i, 1);
+		else glVertexAttribDivisor(AttribLocation + i, 1);
+	}
+}
 
-	if (!OpenGL::coreProfile()) {
-		static bool texCoordArrayEnabled = false;
-		static bool colorArrayEnabled = false;
-		static bool normalArrayEnabled = false;
-		static bool vertexArrayEnabled = false;
+void InstanceBuffer::unbind() {
+	for (int i = 0; i < AttribCount; i++) {
+		if (!OpenGL::coreProfile()) glVertexAttribDivisorARB(AttribLocation + i, 0);
+		else glVertexAttribDivisor(AttribLocation + i, 0);
+		glDisableVertexAttribArray(AttribLocation + i);
+	}
+}
 
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, id);
-		if (format.textureCount != 0) {
-			if (!texCoordArrayEnabled) {
-				glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-				texCoordArrayEnabled = true;
-			}
-			glTexCoordPointer(
-				format.textureCount, GL_FLOAT,
-				format.vertexAttributeCount * sizeof(float),
-				nullptr
-			);
-		} else if (texCoordArrayEnabled) {
-			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-			texCoordArrayEnabled = false;
+void InstanceBuffer::setCurrent(int index) const {
+	const float* attribs = mFallback[index].transform[0];
+	for (int i = 0; i < AttribCount; i++) glVertexAttrib4fv(AttribLocation + i, attribs + i * 4);
+}
+
+// Integer components are normalized, except for coordinates
+static GLboolean normalized(VertexAttribType type) {
+	return (type != VertexAttribFloat && type != VertexAttribHalfFloat) ? GL_TRUE : GL_FALSE;
+}
+
+void VertexBuffer::setAttribPointers(const VertexFormat& format, size_t offset) {
+	int cnt = 0, stride = format.vertexSize();
+	if (format.textureCount != 0) {
+		glVertexAttribPointer(
+			cnt, format.textureCount, format.textureType, normalized(format.textureType), stride,
+			reinterpret_cast<void*>(offset + format.textureOffset())
+		);
+		glEnableVertexAttribArray(cnt++);
+	}
+	if (format.colorCount != 0) {
+		glVertexAttribPointer(
+			cnt, format.colorCount, format.colorType, normalized(format.colorType), stride,
+			reinterpret_cast<void*>(offset + format.colorOffset())
+		);
+		glEnableVertexAttribArray(cnt++);
+	}
+	if (format.normalCount != 0) {
+		glVertexAttribPointer(
+			cnt, format.normalCount, format.normalType, normalized(format.normalType), stride,
+			reinterpret_cast<void*>(offset + format.normalOffset())
+		);
+		glEnableVertexAttribArray(cnt++);
+	}
+	if (format.coordinateCount != 0) {
+		glVertexAttribPointer(
+			cnt, format.coordinateCount, format.coordinateType, GL_FALSE, stride,
+			reinterpret_cast<void*>(offset + format.coordinateOffset())
+		);
+		glEnableVertexAttribArray(cnt++);
+	}
+}
+
+void VertexBuffer::setClientStatePointers(const VertexFormat& format, size_t offset) {
+	int stride = format.vertexSize();
+	if (format.textureCount != 0) {
+		// Fixed function texture coordinates are never normalized
+		Assert(format.textureType == VertexAttribFloat || format.textureType == VertexAttribHalfFloat,
+			   "Unsupported texture coordinate type in compatibility profile");
+		if (!texCoordArrayEnabled) {
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			texCoordArrayEnabled = true;
+		}
+		glTexCoordPointer(
+			format.textureCount, format.textureType, stride,
+			reinterpret_cast<void*>(offset + format.textureOffset())
+		);
+	} else if (texCoordArrayEnabled) {
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		texCoordArrayEnabled = false;
+	}
+
+	if (format.colorCount != 0) {
+		if (!colorArrayEnabled) {
+			glEnableClientState(GL_COLOR_ARRAY);
+			colorArrayEnabled = true;
 		}
+		glColorPointer(
+			format.colorCount, format.colorType, stride,
+			reinterpret_cast<void*>(offset + format.colorOffset())
+		);
+	} else if (colorArrayEnabled) {
+		glDisableClientState(GL_COLOR_ARRAY);
+		colorArrayEnabled = false;
+	}
 
-		if (format.colorCount != 0) {
-			if (!colorArrayEnabled) {
-				glEnableClientState(GL_COLOR_ARRAY);
-				colorArrayEnabled = true;
-			}
-			glColorPointer(
-				format.colorCount, GL_FLOAT,
-				format.vertexAttributeCount * sizeof(float),
-				reinterpret_cast<float*>(format.textureCount * sizeof(float))
-			);
-		} else if (colorArrayEnabled) {
-			glDisableClientState(GL_COLOR_ARRAY);
-			colorArrayEnabled = false;
+	if (format.normalCount != 0) {
+		if (!normalArrayEnabled) {
+			glEnableClientState(GL_NORMAL_ARRAY);
+			normalArrayEnabled = true;
 		}
+		glNormalPointer(
+			/*format.normalCount,*/ format.normalType, stride,
+			reinterpret_cast<void*>(offset + format.normalOffset())
+		);
+	} else if (normalArrayEnabled) {
+		glDisableClientState(GL_NORMAL_ARRAY);
+		normalArrayEnabled = false;
+	}
 
-		if (format.normalCount != 0) {
-			if (!normalArrayEnabled) {
-				glEnableClientState(GL_NORMAL_ARRAY);
-				normalArrayEnabled = true;
-			}
-			glNormalPointer(
-				/*format.normalCount,*/ GL_FLOAT,
-				format.vertexAttributeCount * sizeof(float),
-				reinterpret_cast<float*>((format.textureCount + format.colorCount) * sizeof(float))
-			);
-		} else if (normalArrayEnabled) {
-			glDisableClientState(GL_NORMAL_ARRAY);
-			normalArrayEnabled = false;
+	if (format.coordinateCount != 0) {
+		Assert(format.coordinateType != VertexAttribUnsignedShort && format.coordinateType != VertexAttribUnsignedByte,
+			   "Unsupported coordinate type in compatibility profile");
+		if (!vertexArrayEnabled) {
+			glEnableClientState(GL_VERTEX_ARRAY);
+			vertexArrayEnabled = true;
 		}
+		glVertexPointer(
+			format.coordinateCount, format.coordinateType, stride,
+			reinterpret_cast<void*>(offset + format.coordinateOffset())
+		);
+	} else if (vertexArrayEnabled) {
+		glDisableClientState(GL_VERTEX_ARRAY);
+		vertexArrayEnabled = false;
+	}
+}
+
+void VertexBuffer::update(const VertexFormat& format_, const void* data, int vertexes_, bool staticDraw) {
+	meshIndexes.destroy();
+	// Attribute pointers recorded in the VAO stay valid while the format is unchanged
+	bool respecify = format_ != format;
+	vertexes = vertexes_;
+	format = format_;
+	if (vertexes == 0 && id == 0) return;
 
-		if (format.coordinateCount != 0) {
-			if (!vertexArrayEnabled) {
-				glEnableClientState(GL_VERTEX_ARRAY);
-				vertexArrayEnabled = true;
-			}
-			glVertexPointer(
-				format.coordinateCount, GL_FLOAT,
-				format.vertexAttributeCount * sizeof(float),
-				reinterpret_cast<float*>((format.textureCount + format.colorCount + format.normalCount) * sizeof(float))
-			);
-		} else if (vertexArrayEnabled) {
-			glDisableClientState(GL_VERTEX_ARRAY);
-			vertexArrayEnabled = false;
+	size_t bytes = size_t(vertexes) * format.vertexSize();
+	bool reuse = bytes <= capacity && staticDraw == staticStorage;
+	if (!reuse) {
+		// Grow geometrically when resizing long-lived buffers
+		if (capacity != 0 && staticDraw == staticStorage) capacity = std::max(bytes, capacity + capacity / 2);
+		else capacity = bytes;
+		staticStorage = staticDraw;
+	}
+	if (!OpenGL::coreProfile()) {
+		if (id == 0) glGenBuffersARB(1, &id);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, id);
+		GLenum usage = staticDraw ? GL_STATIC_DRAW_ARB : GL_STREAM_DRAW_ARB;
+		// Orphan streamed storage so that drawing in progress does not stall the upload
+		if (!reuse || !staticDraw) glBufferDataARB(GL_ARRAY_BUFFER_ARB, capacity, nullptr, usage);
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, bytes, data);
+	} else {
+		if (id == 0) {
+			Assert(vao == 0);
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(1, &id);
+			respecify = true;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, id);
+		GLenum usage = staticDraw ? GL_STATIC_DRAW : GL_STREAM_DRAW;
+		if (!reuse || !staticDraw) glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, usage);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+		if (respecify) {
+			glBindVertexArray(vao);
+			setAttribPointers(format);
+			glBindVertexArray(0);
 		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void VertexBuffer::updateRange(int first, int count, const void* data) {
+	Assert(first >= 0 && count >= 0 && first + count <= vertexes, "Vertex range out of bounds");
+	Assert(meshIndexes.empty(), "Partial update of optimized mesh");
+	if (count == 0) return;
+	size_t stride = format.vertexSize();
+	if (!OpenGL::coreProfile()) {
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, id);
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, first * stride, count * stride, data);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, id);
+		glBufferSubData(GL_ARRAY_BUFFER, first * stride, count * stride, data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void VertexBuffer::update(const VertexArray& va, bool staticDraw) {
+	static const bool optimize = Config::getInt("OpenGL.OptimizeStaticMeshes", 0) != 0;
+	if (!staticDraw || !optimize || va.vertexCount() == 0 || va.vertexCount() % 3 != 0) {
+		update(va.format(), va.data(), va.vertexCount(), staticDraw);
+		return;
+	}
+	MeshOptimizer::Mesh mesh = MeshOptimizer::optimize(va.format(), va.data(), va.vertexCount());
+	update(va.format(), mesh.vertices.data(), mesh.vertexCount, true);
+	meshIndexes.update(mesh.indexes.data(), int(mesh.indexes.size()), true);
+}
+
+void VertexBuffer::bind() const {
+	if (!OpenGL::coreProfile()) {
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, id);
+		setClientStatePointers(format);
 	} else {
 		glBindVertexArray(vao);
 	}
+}
+
+void VertexBuffer::render() const {
+	if (empty()) return;
+
+	bind();
 
 	// 本来这里是有一个装逼的框的（
-	glDrawArrays(GL_TRIANGLES, 0, vertexes);
+	if (!meshIndexes.empty()) {
+		meshIndexes.bind();
+		glDrawElements(GL_TRIANGLES, meshIndexes.indexCount(), GL_UNSIGNED_INT, nullptr);
+	} else glDrawArrays(GL_TRIANGLES, 0, vertexes);
 }
 
+void VertexBuffer::renderIndexed(const IndexBuffer& indexes, int count) const {
+	Assert(meshIndexes.empty(), "Optimized mesh rendered with external indexes");
+	if (empty() || indexes.empty()) return;
+	if (count < 0) count = indexes.indexCount();
+
+	bind();
+	indexes.bind();
+	glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, nullptr);
+}
+
+void VertexBuffer::renderInstanced(const InstanceBuffer& instances, const IndexBuffer* indexes, int count) const {
+	if (empty() || instances.empty()) return;
+
+	bind();
+	if (indexes != nullptr) indexes->bind();
+
+	if (!InstanceBuffer::supported()) {
+		// One draw call per instance
+		for (int i = 0; i < instances.instanceCount(); i++) {
+			instances.setCurrent(i);
+			if (indexes != nullptr) glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, nullptr);
+			else glDrawArrays(GL_TRIANGLES, 0, vertexes);
+		}
+		return;
+	}
+
+	instances.bind();
+	if (!OpenGL::coreProfile()) {
+		if (indexes != nullptr) glDrawElementsInstancedARB(GL_TRIANGLES, count, GL_UNSIGNED_INT, nullptr, instances.instanceCount());
+		else glDrawArraysInstancedARB(GL_TRIANGLES, 0, vertexes, instances.instanceCount());
+	} else {
+		if (indexes != nullptr) glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, nullptr, instances.instanceCount());
+		else glDrawArraysInstanced(GL_TRIANGLES, 0, vertexes, instances.instanceCount());
+	}
+	InstanceBuffer::unbind();
+}
@@ -4,9 +4,13 @@
 #include <cstring>
 #include <initializer_list>
 #include <algorithm>
+#include <cmath>
+#include <vector>
 #include "common.h"
 #include "opengl.h"
 #include "debug.h"
+#include "framearena.h"
+#include "mat.h"
 
 class VertexFormat {
 public:
@@ -14,16 +18,113 @@ public:
 	unsigned int textureCount, colorCount, normalCount, coordinateCount;
 	// Vertex attributes count (sum of all)
 	int vertexAttributeCount;
+	// Vertex attribute component types. Integer components are normalized, except for coordinates
+	VertexAttribType textureType, colorType, normalType, coordinateType;
 
-	VertexFormat(): textureCount(0), colorCount(0), normalCount(0), coordinateCount(0), vertexAttributeCount(0) {}
+	VertexFormat(): textureCount(0), colorCount(0), normalCount(0), coordinateCount(0), vertexAttributeCount(0),
+		textureType(VertexAttribFloat), colorType(VertexAttribFloat), normalType(VertexAttribFloat), coordinateType(VertexAttribFloat) {}
 
-	VertexFormat(unsigned int textureElementCount, unsigned int colorElementCount, unsigned int normalElementCount, unsigned int coordinateElementCount):
+	VertexFormat(unsigned int textureElementCount, unsigned int colorElementCount, unsigned int normalElementCount, unsigned int coordinateElementCount,
+				 VertexAttribType textureElementType = VertexAttribFloat, VertexAttribType colorElementType = VertexAttribFloat,
+				 VertexAttribType normalElementType = VertexAttribFloat, VertexAttribType coordinateElementType = VertexAttribFloat):
 		textureCount(textureElementCount), colorCount(colorElementCount), normalCount(normalElementCount), coordinateCount(coordinateElementCount),
-		vertexAttributeCount(textureElementCount + colorElementCount + normalElementCount + coordinateElementCount) {
+		vertexAttributeCount(textureElementCount + colorElementCount + normalElementCount + coordinateElementCount),
+		textureType(textureElementType), colorType(colorElementType), normalType(normalElementType), coordinateType(coordinateElementType) {
 		Assert(textureCount <= 3);
 		Assert(colorCount <= 4);
 		Assert(normalCount == 0 || normalCount == 3);
 		Assert(coordinateCount <= 4 && coordinateCount >= 1);
+		Assert(normalType != VertexAttribUnsignedShort && normalType != VertexAttribUnsignedByte);
+	}
+
+	// Size of a component of given type in bytes
+	static constexpr int typeSize(VertexAttribType type) {
+		return type == VertexAttribFloat ? 4 : (type == VertexAttribUnsignedByte ? 1 : 2);
+	}
+	// Size of an attribute in bytes, padded to 4 bytes
+	static constexpr int attributeSize(unsigned int count, VertexAttribType type) {
+		return (int(count) * typeSize(type) + 3) / 4 * 4;
+	}
+
+	// Attribute offsets in bytes
+	int textureOffset() const { return 0; }
+	int colorOffset() const { return textureOffset() + attributeSize(textureCount, textureType); }
+	int normalOffset() const { return colorOffset() + attributeSize(colorCount, colorType); }
+	int coordinateOffset() const { return normalOffset() + attributeSize(normalCount, normalType); }
+	// Size of a single vertex in bytes
+	int vertexSize() const { return coordinateOffset() + attributeSize(coordinateCount, coordinateType); }
+	// Whether all attributes are floats
+	bool floatsOnly() const {
+		return textureType == VertexAttribFloat && colorType == VertexAttribFloat && normalType == VertexAttribFloat && coordinateType == VertexAttribFloat;
+	}
+
+	bool operator==(const VertexFormat& r) const {
+		return textureCount == r.textureCount && colorCount == r.colorCount && normalCount == r.normalCount && coordinateCount == r.coordinateCount
+			&& textureType == r.textureType && colorType == r.colorType && normalType == r.normalType && coordinateType == r.coordinateType;
+	}
+	bool operator!=(const VertexFormat& r) const { return !(*this == r); }
+	bool operator<(const VertexFormat& r) const {
+		if (textureCount != r.textureCount) return textureCount < r.textureCount;
+		if (colorCount != r.colorCount) return colorCount < r.colorCount;
+		if (normalCount != r.normalCount) return normalCount < r.normalCount;
+		if (coordinateCount != r.coordinateCount) return coordinateCount < r.coordinateCount;
+		if (textureType != r.textureType) return textureType < r.textureType;
+		if (colorType != r.colorType) return colorType < r.colorType;
+		if (normalType != r.normalType) return normalType < r.normalType;
+		return coordinateType < r.coordinateType;
+	}
+};
+
+// Convert float to IEEE half precision (round to nearest even)
+inline unsigned short floatToHalf(float f) {
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned int sign = (x >> 16) & 0x8000u, mant = x & 0x7FFFFFu;
+	int exp = int((x >> 23) & 0xFFu) - 127 + 15;
+	if (((x >> 23) & 0xFFu) == 0xFFu) return (unsigned short)(sign | 0x7C00u | (mant != 0 ? 0x200u : 0u)); // Inf & NaN
+	if (exp >= 31) return (unsigned short)(sign | 0x7C00u); // Overflow
+	unsigned int res, rem, half;
+	if (exp <= 0) { // Subnormal
+		if (exp < -10) return (unsigned short)sign;
+		mant |= 0x800000u;
+		unsigned int shift = unsigned(14 - exp);
+		res = mant >> shift, rem = mant & ((1u << shift) - 1), half = 1u << (shift - 1);
+	} else {
+		res = (unsigned(exp) << 10) | (mant >> 13), rem = mant & 0x1FFFu, half = 0x1000u;
+	}
+	if (rem > half || (rem == half && (res & 1u) != 0)) res++;
+	return (unsigned short)(sign | res);
+}
+
+// Conversion of float attribute values to vertex attribute components
+template <VertexAttribType Type> struct VertexAttribTraits;
+template <> struct VertexAttribTraits<VertexAttribFloat> {
+	using Type = float;
+	static Type convert(float v, bool) { return v; }
+};
+template <> struct VertexAttribTraits<VertexAttribHalfFloat> {
+	using Type = unsigned short;
+	static Type convert(float v, bool) { return floatToHalf(v); }
+};
+template <> struct VertexAttribTraits<VertexAttribShort> {
+	using Type = short;
+	static Type convert(float v, bool normalized) {
+		if (normalized) v = std::min(std::max(v, -1.0f), 1.0f) * 32767.0f;
+		return Type(std::lround(std::min(std::max(v, -32768.0f), 32767.0f)));
+	}
+};
+template <> struct VertexAttribTraits<VertexAttribUnsignedShort> {
+	using Type = unsigned short;
+	static Type convert(float v, bool normalized) {
+		if (normalized) v = std::min(std::max(v, 0.0f), 1.0f) * 65535.0f;
+		return Type(std::min(std::max(v, 0.0f), 65535.0f) + 0.5f);
+	}
+};
+template <> struct VertexAttribTraits<VertexAttribUnsignedByte> {
+	using Type = unsigned char;
+	static Type convert(float v, bool normalized) {
+		if (normalized) v = std::min(std::max(v, 0.0f), 1.0f) * 255.0f;
+		return Type(std::min(std::max(v, 0.0f), 255.0f) + 0.5f);
 	}
 };
 
@@ -31,19 +132,18 @@ class VertexArray {
 public:
 	VertexArray(unsigned int maxVertexes, const VertexFormat& format):
 		mMaxVertexes(maxVertexes), mVertexes(0), mFormat(format),
-		mData(new float[mMaxVertexes * format.vertexAttributeCount]),
-		mVertexAttributes(new float[format.vertexAttributeCount]) { clear(); }
-
-	~VertexArray() {
-		delete[] mData;
-		delete[] mVertexAttributes;
+		mData(new float[mMaxVertexes * format.vertexAttributeCount]) {
+		Assert(format.floatsOnly());
+		clear();
 	}
 
+	~VertexArray() { delete[] mData; }
+
 	VertexArray(const VertexArray&) = delete;
 	VertexArray& operator=(const VertexArray&) = delete;
 
 	void clear() {
-		memset(mVertexAttributes, 0, mFormat.vertexAttributeCount * sizeof(float));
+		memset(mVertexAttributes, 0, sizeof(mVertexAttributes));
 		mVertexes = 0;
 	}
 
@@ -81,7 +181,7 @@ public:
 	void addVertex(unsigned int size, const float* coords) {
 		Assert(size <= mFormat.coordinateCount);
 		memcpy(mVertexAttributes + mFormat.textureCount + mFormat.colorCount + mFormat.normalCount, coords, size * sizeof(float));
-		Assert(mVertexes < mMaxVertexes);
+		if (mVertexes == mMaxVertexes) grow(mVertexes + 1);
 		memcpy(mData + mVertexes * mFormat.vertexAttributeCount, mVertexAttributes, mFormat.vertexAttributeCount * sizeof(float));
 		mVertexes++;
 	}
@@ -91,6 +191,7 @@ public:
 	}
 
 	void addPrimitive(unsigned int size, std::initializer_list<float> d) {
+		if (mVertexes + int(size) > mMaxVertexes) grow(mVertexes + size);
 		memcpy(mData + mVertexes * mFormat.vertexAttributeCount, d.begin(), size * mFormat.vertexAttributeCount * sizeof(float));
 		mVertexes += size;
 	}
@@ -103,8 +204,8 @@ public:
 	int vertexCount() const { return mVertexes; }
 
 private:
-	// Max vertex count
-	const int mMaxVertexes;
+	// Max vertex count (grows when exceeded)
+	int mMaxVertexes;
 	// Vertex count
 	int mVertexes;
 	// Vertex array format
@@ -112,16 +213,296 @@ private:
 	// Vertex array
 	float* mData;
 	// Current vertex attributes
-	float* mVertexAttributes;
+	float mVertexAttributes[3 + 4 + 3 + 4];
+
+	void grow(int vertexes) {
+		mMaxVertexes = std::max(mMaxVertexes * 2, vertexes);
+		float* data = new float[mMaxVertexes * mFormat.vertexAttributeCount];
+		memcpy(data, mData, mVertexes * mFormat.vertexAttributeCount * sizeof(float));
+		delete[] mData;
+		mData = data;
+	}
+};
+
+// Vertex array with format known at compile time: offsets and strides are constants,
+// so vertexes are built and written with plain stores.
+// Storage comes from FrameArena: contents are only valid until the end of the frame!
+template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+		  VertexAttribType TexType = VertexAttribFloat, VertexAttribType ColType = VertexAttribFloat,
+		  VertexAttribType NormType = VertexAttribFloat, VertexAttribType CoordType = VertexAttribFloat>
+class VertexArrayT {
+public:
+	static_assert(Tex <= 3 && Col <= 4 && (Norm == 0 || Norm == 3) && Coord <= 4 && Coord >= 1, "Invalid vertex format");
+
+	// Attribute offsets & vertex size in bytes
+	static constexpr unsigned int TextureOffset = 0;
+	static constexpr unsigned int ColorOffset = TextureOffset + VertexFormat::attributeSize(Tex, TexType);
+	static constexpr unsigned int NormalOffset = ColorOffset + VertexFormat::attributeSize(Col, ColType);
+	static constexpr unsigned int CoordinateOffset = NormalOffset + VertexFormat::attributeSize(Norm, NormType);
+	static constexpr unsigned int VertexSize = CoordinateOffset + VertexFormat::attributeSize(Coord, CoordType);
+
+	struct Vertex {
+		alignas(4) unsigned char bytes[VertexSize];
+
+		template <typename... T> void setTexture(T... v) {
+			static_assert(sizeof...(T) <= Tex, "Too many texture coordinates");
+			set<TextureOffset, TexType, true>(float(v)...);
+		}
+		template <typename... T> void setColor(T... v) {
+			static_assert(sizeof...(T) <= Col, "Too many color components");
+			set<ColorOffset, ColType, true>(float(v)...);
+		}
+		template <typename... T> void setNormal(T... v) {
+			static_assert(sizeof...(T) <= Norm, "Too many normal components");
+			set<NormalOffset, NormType, true>(float(v)...);
+		}
+		template <typename... T> void setCoordinates(T... v) {
+			static_assert(sizeof...(T) <= Coord, "Too many coordinates");
+			set<CoordinateOffset, CoordType, false>(float(v)...);
+		}
+		void setColor(const float* color) {
+			using Traits = VertexAttribTraits<ColType>;
+			for (unsigned int i = 0; i < Col; i++) {
+				typename Traits::Type c = Traits::convert(color[i], true);
+				memcpy(bytes + ColorOffset + i * sizeof(c), &c, sizeof(c));
+			}
+		}
+
+	private:
+		template <unsigned int Offset, VertexAttribType Type, bool Normalized> void set() {}
+		template <unsigned int Offset, VertexAttribType Type, bool Normalized, typename... T> void set(float v0, T... rest) {
+			using Traits = VertexAttribTraits<Type>;
+			typename Traits::Type c = Traits::convert(v0, Normalized);
+			memcpy(bytes + Offset, &c, sizeof(c));
+			set<Offset + sizeof(c), Type, Normalized>(rest...);
+		}
+	};
+
+	explicit VertexArrayT(unsigned int capacity = 0) { reserve(capacity); }
+
+	VertexArrayT(const VertexArrayT&) = delete;
+	VertexArrayT& operator=(const VertexArrayT&) = delete;
+
+	void clear() {
+		mCurrent = Vertex();
+		mVertexes = 0;
+	}
+
+	// Make room for at least `capacity` vertexes
+	void reserve(size_t capacity) {
+		if (capacity <= mCapacity) return;
+		// Previous storage is left to the arena
+		Vertex* data = FrameArena::allocate<Vertex>(capacity);
+		if (mVertexes > 0) memcpy(data, mData, mVertexes * sizeof(Vertex));
+		mData = data;
+		mCapacity = capacity;
+	}
+
+	// Set attributes of subsequent vertexes
+	template <typename... T> void setTexture(T... v) { mCurrent.setTexture(v...); }
+	template <typename... T> void setColor(T... v) { mCurrent.setColor(v...); }
+	void setColor(const float* color) { mCurrent.setColor(color); }
+	template <typename... T> void setNormal(T... v) { mCurrent.setNormal(v...); }
+
+	// Add vertex with current attributes
+	template <typename... T> void addVertex(T... coords) {
+		mCurrent.setCoordinates(coords...);
+		Vertex v = mCurrent;
+		*allocate(1) = v;
+	}
+	// Add prebuilt vertexes
+	void addVertices(const Vertex* vertices, size_t count) { memcpy(allocate(count), vertices, count * sizeof(Vertex)); }
+	void addVertices(std::initializer_list<Vertex> vertices) { addVertices(vertices.begin(), vertices.size()); }
+	// Add quad as 4 vertexes, forming triangles (v0, v1, v2) & (v2, v1, v3) when drawn with IndexBuffer::quads()
+	void addQuad(const Vertex& v0, const Vertex& v1, const Vertex& v2, const Vertex& v3) {
+		Vertex* p = allocate(4);
+		p[0] = v0, p[1] = v1, p[2] = v2, p[3] = v3;
+	}
+	// Add quad with current attributes, returns its 4 vertexes to be completed by the caller
+	Vertex* addQuad() {
+		// Copy current attributes first: stores into the array may alias mCurrent
+		const Vertex c = mCurrent;
+		Vertex* p = allocate(4);
+		p[0] = c, p[1] = c, p[2] = c, p[3] = c;
+		return p;
+	}
+	// Add axis-aligned quad on XY plane with current attributes
+	void addQuad(float x0, float y0, float x1, float y1) {
+		Vertex* p = addQuad();
+		p[0].setCoordinates(x0, y0);
+		p[1].setCoordinates(x0, y1);
+		p[2].setCoordinates(x1, y0);
+		p[3].setCoordinates(x1, y1);
+	}
+
+	// Get vertex with current attributes and given coordinates
+	template <typename... T> Vertex vertex(T... coords) const {
+		Vertex res = mCurrent;
+		res.setCoordinates(coords...);
+		return res;
+	}
+	// Get current vertex attributes
+	const Vertex& current() const { return mCurrent; }
+	// Get vertex format
+	static VertexFormat format() { return VertexFormat(Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType); }
+	// Get current vertex data
+	const void* data() const { return mVertexes == 0 ? nullptr : mData[0].bytes; }
+	// Get current vertex count
+	int vertexCount() const { return int(mVertexes); }
+
+private:
+	Vertex* mData = nullptr;
+	size_t mVertexes = 0, mCapacity = 0;
+	Vertex mCurrent = Vertex();
+
+	// Append `count` uninitialized vertexes, growing if needed
+	Vertex* allocate(size_t count) {
+		if (mVertexes + count > mCapacity) reserve(std::max(mCapacity * 2, mVertexes + count));
+		Vertex* res = mData + mVertexes;
+		mVertexes += count;
+		return res;
+	}
+};
+
+// Triangle indexes stored in a buffer object
+class IndexBuffer {
+public:
+	IndexBuffer(): id(0), indexes(0) {}
+	IndexBuffer(IndexBuffer&& r) noexcept: id(0), indexes(0) { swap(r); }
+	IndexBuffer(const unsigned int* data, int indexes_, bool staticDraw = false): id(0), indexes(0) {
+		update(data, indexes_, staticDraw);
+	}
+	~IndexBuffer() { destroy(); }
+
+	IndexBuffer& operator=(IndexBuffer&& r) noexcept {
+		swap(r);
+		return *this;
+	}
+
+	// Is empty
+	bool empty() const { return id == 0; }
+	// Get index count
+	int indexCount() const { return indexes; }
+	// Upload new data
+	void update(const unsigned int* data, int indexes_, bool staticDraw = false);
+	// Bind as element array buffer (core profile: recorded in the bound VAO)
+	void bind() const;
+	// Swap
+	void swap(IndexBuffer& r) {
+		std::swap(id, r.id);
+		std::swap(indexes, r.indexes);
+	}
+	// Destroy index buffer
+	void destroy();
+
+	// Shared indexes for quads stored as 4 vertexes each (see VertexArrayT::addQuad()),
+	// grown on demand to hold at least the given number of quads
+	static const IndexBuffer& quads(int count);
+	// Release shared quad indexes. Must be called before OpenGL context is destroyed!
+	static void releaseQuads();
+
+private:
+	// Buffer ID
+	VertexBufferID id;
+	// Index count
+	int indexes;
+
+	static IndexBuffer mQuads;
+};
+
+// Per-instance attributes for instanced rendering (see Instanced.vsh)
+struct InstanceAttributes {
+	// Affine transform applied to vertex coordinates (first 3 rows of a row-major matrix)
+	float transform[3][4];
+	// Multiplied with vertex color
+	float color[4];
+	// Texture coordinates (u, v) are mapped to (x + u * z, y + v * w)
+	float texRect[4];
+
+	InstanceAttributes() {
+		setTransform(Mat4f(1.0f));
+		setColor(1.0f, 1.0f, 1.0f, 1.0f);
+		setTexRect(0.0f, 0.0f, 1.0f, 1.0f);
+	}
+
+	void setTransform(const Mat4f& mat) { memcpy(transform, mat.data, sizeof(transform)); }
+	void setColor(float r, float g, float b, float a) { color[0] = r, color[1] = g, color[2] = b, color[3] = a; }
+	void setTexRect(float x, float y, float w, float h) { texRect[0] = x, texRect[1] = y, texRect[2] = w, texRect[3] = h; }
+};
+
+// Per-instance attributes stored in a buffer object
+class InstanceBuffer {
+public:
+	// Generic vertex attribute locations of instance attributes: transform rows, color, texRect.
+	// Chosen not to alias fixed function arrays on some drivers (0: vertex, 2: normal, 3: color, 8: texcoord 0)
+	static constexpr GLuint AttribLocation = 9;
+	static constexpr int AttribCount = 5;
+
+	InstanceBuffer(): id(0), instances(0) {}
+	InstanceBuffer(InstanceBuffer&& r) noexcept: id(0), instances(0) { swap(r); }
+	InstanceBuffer(const InstanceAttributes* data, int instances_, bool staticDraw = false): id(0), instances(0) {
+		update(data, instances_, staticDraw);
+	}
+	~InstanceBuffer() { destroy(); }
+
+	InstanceBuffer& operator=(InstanceBuffer&& r) noexcept {
+		swap(r);
+		return *this;
+	}
+
+	// Is empty
+	bool empty() const { return instances == 0; }
+	// Get instance count
+	int instanceCount() const { return instances; }
+	// Upload new data
+	void update(const InstanceAttributes* data, int instances_, bool staticDraw = false);
+	void update(const std::vector<InstanceAttributes>& data, bool staticDraw = false) {
+		update(data.data(), int(data.size()), staticDraw);
+	}
+	// Swap
+	void swap(InstanceBuffer& r) {
+		std::swap(id, r.id);
+		std::swap(instances, r.instances);
+		std::swap(mFallback, r.mFallback);
+	}
+	// Destroy instance buffer
+	void destroy();
+
+	// Set up instanced attribute arrays for the next draw
+	void bind() const;
+	static void unbind();
+	// Set instance attributes as constant vertex attributes (fallback without instanced arrays)
+	void setCurrent(int index) const;
+
+	// Instanced arrays are available (glVertexAttribDivisor in core profile, ARB_instanced_arrays otherwise)
+	static bool supported() { return OpenGL::coreProfile() ? GLEW_VERSION_3_3 != 0 : GLEW_ARB_instanced_arrays != 0; }
+
+private:
+	// Buffer ID
+	VertexBufferID id;
+	// Instance count
+	int instances;
+	// Attributes kept in memory when instanced arrays are not supported
+	std::vector<InstanceAttributes> mFallback;
 };
 
 class VertexBuffer {
 public:
-	VertexBuffer(): id(0), vao(0), vertexes(0) {}
-	VertexBuffer(VertexBuffer&& r) noexcept: id(0), vao(0), vertexes(0) { swap(r); }
+	VertexBuffer(): id(0), vao(0), vertexes(0), capacity(0), staticStorage(false) {}
+	VertexBuffer(VertexBuffer&& r) noexcept: VertexBuffer() { swap(r); }
 	/*VertexBuffer(VertexBufferID id_, int vertexes_, const VertexFormat& format_):
 		id(id_), vertexes(vertexes_), format(format_) {}*/
-	explicit VertexBuffer(const VertexArray& va, bool staticDraw = false);
+	VertexBuffer(const VertexFormat& format_, const void* data, int vertexes_, bool staticDraw = false): VertexBuffer() {
+		update(format_, data, vertexes_, staticDraw);
+	}
+	// Static triangle lists are optimized when "OpenGL.OptimizeStaticMeshes" is set, off by default (see MeshOptimizer)
+	explicit VertexBuffer(const VertexArray& va, bool staticDraw = false): VertexBuffer() {
+		update(va, staticDraw);
+	}
+	template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+			  VertexAttribType TexType, VertexAttribType ColType, VertexAttribType NormType, VertexAttribType CoordType>
+	explicit VertexBuffer(const VertexArrayT<Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType>& va, bool staticDraw = false):
+		VertexBuffer(va.format(), va.data(), va.vertexCount(), staticDraw) {}
 	~VertexBuffer() { destroy(); }
 
 	VertexBuffer& operator=(VertexBuffer&& r) noexcept {
@@ -135,23 +516,51 @@ public:
 			Assert(vertexes == 0);
 			return true;
 		}
-		return false;
+		return vertexes == 0;
 	}
-	// Upload new data
+	// Upload new data (existing storage is reused when large enough)
+	void update(const VertexFormat& format_, const void* data, int vertexes_, bool staticDraw = false);
 	void update(const VertexArray& va, bool staticDraw = false);
+	// Overwrite `count` vertexes starting from `first`, in the current format
+	void updateRange(int first, int count, const void* data);
+	template <unsigned int Tex, unsigned int Col, unsigned int Norm, unsigned int Coord,
+			  VertexAttribType TexType, VertexAttribType ColType, VertexAttribType NormType, VertexAttribType CoordType>
+	void update(const VertexArrayT<Tex, Col, Norm, Coord, TexType, ColType, NormType, CoordType>& va, bool staticDraw = false) {
+		update(va.format(), va.data(), va.vertexCount(), staticDraw);
+	}
 	// Swap
 	void swap(VertexBuffer& r) {
 		std::swap(id, r.id);
 		std::swap(vao, r.vao);
 		std::swap(vertexes, r.vertexes);
 		std::swap(format, r.format);
+		std::swap(capacity, r.capacity);
+		std::swap(staticStorage, r.staticStorage);
+		meshIndexes.swap(r.meshIndexes);
 	}
+	// Set up vertex data for drawing
+	void bind() const;
 	// Render vertex buffer
 	void render() const;
+	// Render vertex buffer with the first `count` indexes of given index buffer (all when negative)
+	void renderIndexed(const IndexBuffer& indexes, int count = -1) const;
+	// Render vertex buffer made of quads (see VertexArrayT::addQuad())
+	void renderQuads() const {
+		renderIndexed(IndexBuffer::quads(vertexes / 4), vertexes / 4 * 6);
+	}
+	// Render one copy of the vertex buffer per instance, in a single draw call when supported
+	void renderInstanced(const InstanceBuffer& instances) const {
+		renderInstanced(instances, meshIndexes.empty() ? nullptr : &meshIndexes, meshIndexes.indexCount());
+	}
+	void renderQuadsInstanced(const InstanceBuffer& instances) const {
+		Assert(meshIndexes.empty(), "Optimized mesh rendered as quads");
+		renderInstanced(instances, &IndexBuffer::quads(vertexes / 4), vertexes / 4 * 6);
+	}
 	// Destroy vertex buffer
 	void destroy() {
 		format = VertexFormat();
-		if (empty()) return;
+		meshIndexes.destroy();
+		if (id == 0) return;
 		if (!OpenGL::coreProfile()) {
 			glDeleteBuffersARB(1, &id);
 		} else {
@@ -159,15 +568,30 @@ public:
 			glDeleteBuffers(1, &id);
 		}
 		vertexes = id = vao = 0;
+		capacity = 0;
 	}
 
+	// Specify generic attribute pointers for the bound buffer (core profile, VAO must be bound)
+	static void setAttribPointers(const VertexFormat& format, size_t offset = 0);
+	// Specify client state pointers for the bound buffer (compatibility profile)
+	static void setClientStatePointers(const VertexFormat& format, size_t offset = 0);
+
 private:
 	// Buffer ID
 	VertexBufferID id, vao;
 	// Vertex count
 	int vertexes;
+	// Allocated storage in bytes
+	size_t capacity;
+	// Storage allocated with GL_STATIC_DRAW
+	bool staticStorage;
 	// Buffer format
 	VertexFormat format;
+	// Triangle indexes of an optimized mesh (empty for plain triangle lists)
+	IndexBuffer meshIndexes;
+
+	// Draw instanced, with first `count` indexes when given an index buffer
+	void renderInstanced(const InstanceBuffer& instances, const IndexBuffer* indexes, int count) const;
 };
 
 #endif // !VERTEXARRAY_H_
@@ -0,0 +1,328 @@
+#include "virtualtexture.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include "config.h"
+#include "logger.h"
+#include "mipchain.h"
+
+constexpr const char* VirtualTexture::Extension;
+constexpr int VirtualTexture::TileSize;
+constexpr int VirtualTexture::TileBorder;
+constexpr int VirtualTexture::SlotSize;
+
+namespace {
+	// File layout: header, level table, then tiles of all levels (finest first, row by row),
+	// each one SlotSize x SlotSize pixels with 4-byte aligned rows
+	const uint32_t Magic = 0x58455456; // "VTEX"
+	const uint32_t Version = 1;
+	const size_t DataAlignment = 16;
+
+	struct Header {
+		uint32_t magic, version, bytesPerPixel, levels, tileSize, tileBorder;
+	};
+	struct LevelEntry {
+		uint32_t width, height;
+	};
+
+	size_t alignUp(size_t offset) { return (offset + DataAlignment - 1) / DataAlignment * DataAlignment; }
+}
+
+bool VirtualTexture::cook(const std::string& source, const std::string& filename) {
+	TextureImage image;
+	std::string ext = source.substr(std::min(source.rfind('.'), source.size()));
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+	if (ext == ".bmp") image.loadFromBMP(source);
+	else image.loadFromPNG(source);
+	if (image.empty()) return false;
+
+	// Levels down to the first one fitting into a single tile
+	int levels = 1;
+	for (int w = image.width(), h = image.height(); std::max(w, h) > TileSize; levels++) w = std::max(w / 2, 1), h = std::max(h / 2, 1);
+	bool gammaCorrect = Config::getInt("OpenGL.GammaCorrectMipmaps", 0) != 0;
+	MipChain chain(image, levels, gammaCorrect);
+	int bpp = chain.bytesPerPixel();
+
+	Header header = { Magic, Version, uint32_t(bpp), uint32_t(levels), uint32_t(TileSize), uint32_t(TileBorder) };
+	std::vector<LevelEntry> table;
+	for (int i = 0; i < levels; i++) table.push_back({ uint32_t(chain.width(i)), uint32_t(chain.height(i)) });
+	std::ofstream out(filename, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(table.data()), std::streamsize(sizeof(LevelEntry) * table.size()));
+	std::vector<char> padding(alignUp(size_t(out.tellp())) - size_t(out.tellp()), 0);
+	out.write(padding.data(), std::streamsize(padding.size()));
+
+	int pitch = TextureImage::alignedPitch(SlotSize * bpp);
+	std::vector<unsigned char> tile(size_t(pitch) * SlotSize, 0);
+	for (int i = 0; i < levels && out; i++) {
+		TextureImage level = chain.level(i);
+		int width = level.width(), height = level.height();
+		for (int ty = 0; ty * TileSize < height; ty++) for (int tx = 0; tx * TileSize < width; tx++) {
+			// Pixels outside the level repeat its edges
+			int x0 = tx * TileSize - TileBorder, y0 = ty * TileSize - TileBorder;
+			int begin = std::max(-x0, 0), end = std::min(width - x0, SlotSize);
+			for (int r = 0; r < SlotSize; r++) {
+				const unsigned char* src = level.data() + size_t(std::min(std::max(y0 + r, 0), height - 1)) * level.pitch();
+				unsigned char* dst = tile.data() + size_t(r) * pitch;
+				for (int c = 0; c < begin; c++) memcpy(dst + c * bpp, src, bpp);
+				memcpy(dst + begin * bpp, src + (x0 + begin) * bpp, size_t(end - begin) * bpp);
+				for (int c = end; c < SlotSize; c++) memcpy(dst + c * bpp, src + (width - 1) * bpp, bpp);
+			}
+			out.write(reinterpret_cast<const char*>(tile.data()), std::streamsize(tile.size()));
+		}
+	}
+	if (!out) {
+		LogWarning("Failed to write virtual texture \"" + filename + "\"");
+		return false;
+	}
+	LogInfo("Cooked \"" + source + "\" into virtual texture \"" + filename + "\"");
+	return true;
+}
+
+bool VirtualTexture::open(const std::string& filename, bool bilinear) {
+	close();
+	// Tiles are read in any order
+	if (!mFile.open(filename, false)) {
+		LogWarning("Failed to open virtual texture \"" + filename + "\"");
+		return false;
+	}
+	const unsigned char* data = mFile.data();
+	size_t size = mFile.size();
+	Header header;
+	if (size >= sizeof(Header)) memcpy(&header, data, sizeof(Header));
+	if (size < sizeof(Header) || header.magic != Magic || header.version != Version || header.bytesPerPixel == 0 || header.bytesPerPixel > 4 || Texture::expandNeeded(int(header.bytesPerPixel)) ||
+		header.tileSize != uint32_t(TileSize) || header.tileBorder != uint32_t(TileBorder) || header.levels == 0 || header.levels > 32 ||
+		size < sizeof(Header) + sizeof(LevelEntry) * header.levels) {
+		LogWarning("Failed to load file \"" + filename + "\" as virtual texture");
+		close();
+		return false;
+	}
+	mBytesPerPixel = int(header.bytesPerPixel);
+	int tiles = 0;
+	for (uint32_t i = 0; i < header.levels; i++) {
+		LevelEntry entry;
+		memcpy(&entry, data + sizeof(Header) + sizeof(LevelEntry) * i, sizeof(LevelEntry));
+		if (entry.width == 0 || entry.height == 0 || entry.width > (1u << 24) || entry.height > (1u << 24)) {
+			LogWarning("Failed to load file \"" + filename + "\" as virtual texture");
+			close();
+			return false;
+		}
+		Level level = { int(entry.width), int(entry.height), 0, 0, tiles };
+		level.tilesX = (level.width + TileSize - 1) / TileSize;
+		level.tilesY = (level.height + TileSize - 1) / TileSize;
+		tiles += level.tilesX * level.tilesY;
+		mLevels.push_back(level);
+	}
+	mTileBytes = size_t(TextureImage::alignedPitch(SlotSize * mBytesPerPixel)) * SlotSize;
+	mDataOffset = alignUp(sizeof(Header) + sizeof(LevelEntry) * header.levels);
+	if (mLevels.back().tilesX != 1 || mLevels.back().tilesY != 1 || size < mDataOffset || (size - mDataOffset) / mTileBytes < size_t(tiles)) {
+		LogWarning("Failed to load file \"" + filename + "\" as virtual texture");
+		close();
+		return false;
+	}
+	mWidth = mLevels[0].width, mHeight = mLevels[0].height;
+
+	// Cache texture of whole slots, within the size limit of the implementation
+	mCacheSize = std::min(Config::getInt("VirtualTexture.CacheSize", 4096), Texture::maxSize());
+	mCacheSize = std::max(mCacheSize / SlotSize, 1) * SlotSize;
+	mSlotsPerRow = mCacheSize / SlotSize;
+	mSlots.assign(size_t(mSlotsPerRow) * mSlotsPerRow, Slot());
+	// Single channel images are gray (masks are not cooked)
+	mCache.create(mCacheSize, mCacheSize, mBytesPerPixel, mBytesPerPixel == 2 || mBytesPerPixel == 4, bilinear);
+	Texture::unbind();
+	mTable.assign(tiles, -1);
+	mPending.assign(tiles, false);
+	mUploadsPerFrame = std::max(Config::getInt("VirtualTexture.UploadsPerFrame", 8), 1);
+	mLevel = levels() - 1;
+	mFrame = 0;
+
+	// The coarsest tile stands in for all others until they are loaded
+	mRequests.push_back(tiles - 1);
+	mPending[tiles - 1] = true;
+	mQuit = false;
+	int threads = std::max(Config::getInt("VirtualTexture.Threads", 2), 1);
+	for (int i = 0; i < threads; i++) mThreads.emplace_back(&VirtualTexture::worker, this);
+
+	std::stringstream ss;
+	ss << "Virtual texture \"" << filename << "\": " << mWidth << "x" << mHeight << ", " << levels() << " levels, " << mSlots.size() << " cache slots";
+	LogInfo(ss.str());
+	return true;
+}
+
+void VirtualTexture::close() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (auto& curr: mThreads) curr.join();
+	mThreads.clear();
+	mRequests.clear();
+	mLoaded.clear();
+	mCache = Texture();
+	mFile.close();
+	mLevels.clear();
+	mTable.clear();
+	mPending.clear();
+	mSlots.clear();
+	mWidth = mHeight = mBytesPerPixel = 0;
+}
+
+void VirtualTexture::worker() {
+	while (true) {
+		int tile;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]() { return mQuit || !mRequests.empty(); });
+			if (mQuit) return;
+			tile = mRequests.front();
+			mRequests.pop_front();
+		}
+		// Page faults (disk reads) happen here, not on the main thread
+		LoadedTile loaded;
+		loaded.tile = tile;
+		const unsigned char* src = mFile.data() + mDataOffset + size_t(tile) * mTileBytes;
+		loaded.pixels.assign(src, src + mTileBytes);
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLoaded.push_back(std::move(loaded));
+	}
+}
+
+void VirtualTexture::upload() {
+	TextureFormat internalFormat, format;
+	Texture::formats(mBytesPerPixel, mBytesPerPixel == 2 || mBytesPerPixel == 4, internalFormat, format);
+	bool bound = false;
+	for (int i = 0; i < mUploadsPerFrame; i++) {
+		LoadedTile loaded;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mLoaded.empty()) break;
+			loaded = std::move(mLoaded.front());
+			mLoaded.pop_front();
+		}
+		mPending[loaded.tile] = false;
+
+		// Free slot, or the least recently used one not drawn in this or the previous frame
+		int best = -1;
+		for (int j = 0; j < int(mSlots.size()); j++) {
+			const Slot& slot = mSlots[j];
+			if (slot.tile < 0) {
+				best = j;
+				break;
+			}
+			if (slot.lastUsed + 1 >= mFrame) continue;
+			if (best < 0 || slot.lastUsed < mSlots[best].lastUsed) best = j;
+		}
+		// All in use, requested again if still needed
+		if (best < 0) continue;
+		Slot& slot = mSlots[best];
+		if (slot.tile >= 0) mTable[slot.tile] = -1;
+		slot.tile = loaded.tile;
+		slot.lastUsed = mFrame;
+		mTable[loaded.tile] = best;
+
+		if (!bound) mCache.bind(), bound = true;
+		int x = best % mSlotsPerRow * SlotSize, y = best / mSlotsPerRow * SlotSize;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, SlotSize, SlotSize, format, GL_UNSIGNED_BYTE, loaded.pixels.data());
+	}
+	if (bound) Texture::unbind();
+}
+
+int VirtualTexture::residentTile(int& level, int& x, int& y) const {
+	for (; level < levels(); level++) {
+		int res = tile(level, x, y);
+		if (mTable[res] >= 0) return res;
+		// Next level may be a pixel narrower than half of this one
+		if (level + 1 < levels()) x = std::min(x / 2, mLevels[level + 1].tilesX - 1), y = std::min(y / 2, mLevels[level + 1].tilesY - 1);
+	}
+	return -1;
+}
+
+void VirtualTexture::tileRange(int level, const UVRect& visible, int& x0, int& y0, int& x1, int& y1) const {
+	const Level& curr = mLevels[level];
+	x0 = std::min(std::max(int(std::floor(visible.u0 * curr.width / TileSize)), 0), curr.tilesX - 1);
+	y0 = std::min(std::max(int(std::floor(visible.v0 * curr.height / TileSize)), 0), curr.tilesY - 1);
+	x1 = std::min(std::max(int(std::ceil(visible.u1 * curr.width / TileSize)), x0 + 1), curr.tilesX);
+	y1 = std::min(std::max(int(std::ceil(visible.v1 * curr.height / TileSize)), y0 + 1), curr.tilesY);
+}
+
+void VirtualTexture::update(const UVRect& visible, float width, float height) {
+	if (empty()) return;
+	upload();
+
+	// Level with 1 to 2 image pixels per screen pixel
+	float ratio = std::max((visible.u1 - visible.u0) * mWidth / std::max(width, 1.0f), (visible.v1 - visible.v0) * mHeight / std::max(height, 1.0f));
+	int level = 0;
+	while (ratio >= 2.0f && level + 1 < levels()) ratio /= 2.0f, level++;
+	// Coarser while the visible tiles and coarser ones standing in for them would not fit into the cache
+	int x0, y0, x1, y1;
+	while (true) {
+		tileRange(level, visible, x0, y0, x1, y1);
+		int count = (x1 - x0) * (y1 - y0);
+		if (level + 1 == levels() || count + count / 3 < int(mSlots.size())) break;
+		level++;
+	}
+	mLevel = level;
+
+	// Keep drawn tiles, then request missing ones, nearest to the center first
+	std::vector<std::pair<float, int>> missing;
+	const Level& curr = mLevels[level];
+	float cx = (visible.u0 + visible.u1) * 0.5f * curr.width / TileSize - 0.5f;
+	float cy = (visible.v0 + visible.v1) * 0.5f * curr.height / TileSize - 0.5f;
+	int coarsest = int(mTable.size()) - 1;
+	if (mTable[coarsest] >= 0) mSlots[mTable[coarsest]].lastUsed = mFrame;
+	std::lock_guard<std::mutex> lock(mMutex);
+	// Requests not taken by loader threads yet are dropped unless still needed
+	for (int tile: mRequests) mPending[tile] = false;
+	mRequests.clear();
+	if (mTable[coarsest] < 0 && !mPending[coarsest]) mRequests.push_back(coarsest), mPending[coarsest] = true;
+	for (int y = y0; y < y1; y++) for (int x = x0; x < x1; x++) {
+		int resLevel = level, resX = x, resY = y;
+		int res = residentTile(resLevel, resX, resY);
+		if (res >= 0) mSlots[mTable[res]].lastUsed = mFrame;
+		int wanted = tile(level, x, y);
+		if (res != wanted && !mPending[wanted]) missing.emplace_back((x - cx) * (x - cx) + (y - cy) * (y - cy), wanted);
+	}
+	std::sort(missing.begin(), missing.end());
+	for (const auto& request: missing) {
+		mRequests.push_back(request.second);
+		mPending[request.second] = true;
+	}
+	if (!mRequests.empty()) mWake.notify_all();
+	mFrame++;
+}
+
+void VirtualTexture::quads(const UVRect& visible, std::vector<Quad>& res) const {
+	res.clear();
+	if (empty()) return;
+	int x0, y0, x1, y1;
+	tileRange(mLevel, visible, x0, y0, x1, y1);
+	const Level& curr = mLevels[mLevel];
+	for (int y = y0; y < y1; y++) for (int x = x0; x < x1; x++) {
+		// Tile rectangle clipped to the visible part
+		Quad quad;
+		quad.image.u0 = std::max(visible.u0, float(x * TileSize) / curr.width);
+		quad.image.v0 = std::max(visible.v0, float(y * TileSize) / curr.height);
+		quad.image.u1 = std::min(visible.u1, float(std::min((x + 1) * TileSize, curr.width)) / curr.width);
+		quad.image.v1 = std::min(visible.v1, float(std::min((y + 1) * TileSize, curr.height)) / curr.height);
+		if (quad.image.u0 >= quad.image.u1 || quad.image.v0 >= quad.image.v1) continue;
+		int level = mLevel, tx = x, ty = y;
+		int tile = residentTile(level, tx, ty);
+		if (tile < 0) continue;
+		// Image coordinates to pixels of the level, then to the slot of the tile
+		const Level& src = mLevels[level];
+		int slot = mTable[tile];
+		float sx = float(slot % mSlotsPerRow * SlotSize + TileBorder - tx * TileSize);
+		float sy = float(slot / mSlotsPerRow * SlotSize + TileBorder - ty * TileSize);
+		float scale = 1.0f / float(mCacheSize);
+		quad.cache.u0 = (sx + quad.image.u0 * src.width) * scale;
+		quad.cache.v0 = (sy + quad.image.v0 * src.height) * scale;
+		quad.cache.u1 = (sx + quad.image.u1 * src.width) * scale;
+		quad.cache.v1 = (sy + quad.image.v1 * src.height) * scale;
+		res.push_back(quad);
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef VIRTUALTEXTURE_H_
+#define VIRTUALTEXTURE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "texture.h"
+#include "textureatlas.h"
+#include "mappedfile.h"
+
+// Image larger than a texture may be (see Texture::maxSize()), shown through a fixed-size tile cache.
+// The image is cooked into a pyramid of tiles on disk (see cook()), which is memory mapped when opened.
+// Tiles needed for the visible part at the current zoom are read on loader threads ("VirtualTexture.Threads")
+// and uploaded into slots of one cache texture ("VirtualTexture.CacheSize" pixels square). An indirection table
+// maps tiles to slots; missing tiles are drawn from the finest resident coarser tile meanwhile.
+class VirtualTexture {
+public:
+	// File name extension of cooked tile pyramids
+	static constexpr const char* Extension = ".vtex";
+	// Image pixels per tile, and the border of pixels repeated from its neighbours (for bilinear filtering)
+	static constexpr int TileSize = 254, TileBorder = 1;
+	// Pixels per cache slot
+	static constexpr int SlotSize = TileSize + TileBorder * 2;
+
+	// Part of the image drawn from a cache slot
+	struct Quad {
+		// Image rectangle ([0, 1] over the whole image), and its texture coordinates in the cache texture
+		UVRect image, cache;
+	};
+
+	VirtualTexture() = default;
+	VirtualTexture(const VirtualTexture&) = delete;
+	~VirtualTexture() { close(); }
+
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	// Decode PNG/BMP image, build its tile pyramid ("OpenGL.GammaCorrectMipmaps") and write it
+	static bool cook(const std::string& source, const std::string& filename);
+
+	// Map tile pyramid, create the cache texture & start loader threads. Must be called after OpenGL context is available!
+	bool open(const std::string& filename, bool bilinear = true);
+	void close();
+
+	// Upload loaded tiles, then request those needed to show the `visible` part of the image
+	// on `width` x `height` screen pixels. Call once per frame.
+	void update(const UVRect& visible, float width, float height);
+	// Quads covering the visible part with the finest resident tiles
+	void quads(const UVRect& visible, std::vector<Quad>& res) const;
+	const Texture& texture() const { return mCache; }
+
+	bool empty() const { return mLevels.empty(); }
+	int width() const { return mWidth; }
+	int height() const { return mHeight; }
+	int levels() const { return int(mLevels.size()); }
+	// Level selected by the last update()
+	int level() const { return mLevel; }
+
+private:
+	struct Level {
+		int width, height, tilesX, tilesY;
+		// Index of its first tile (tiles of all levels are numbered together, finest level first)
+		int first;
+	};
+	struct Slot {
+		int tile = -1;
+		unsigned long long lastUsed = 0;
+	};
+	struct LoadedTile {
+		int tile;
+		std::vector<unsigned char> pixels;
+	};
+
+	MappedFile mFile;
+	int mWidth = 0, mHeight = 0, mBytesPerPixel = 0;
+	std::vector<Level> mLevels;
+	// Bytes per tile in the file (rows aligned like TextureImage) & offset of the first one
+	size_t mTileBytes = 0, mDataOffset = 0;
+
+	// Indirection table: slot of each tile, -1 when not resident
+	std::vector<int> mTable;
+	// Tile requested from the loader threads & not uploaded yet
+	std::vector<bool> mPending;
+	std::vector<Slot> mSlots;
+	Texture mCache;
+	int mCacheSize = 0, mSlotsPerRow = 0;
+	int mLevel = 0, mUploadsPerFrame = 0;
+	unsigned long long mFrame = 0;
+
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mQuit = false;
+	// Tiles to read (most important first) & read ones waiting for upload
+	std::deque<int> mRequests;
+	std::deque<LoadedTile> mLoaded;
+
+	void worker();
+	// Copy loaded tiles into free or least recently used slots
+	void upload();
+	int tile(int level, int x, int y) const { return mLevels[level].first + y * mLevels[level].tilesX + x; }
+	// Finest resident tile covering the given one (-1 when none), moves level & position to it
+	int residentTile(int& level, int& x, int& y) const;
+	// Tiles of level covering the visible part: [x0, x1) x [y0, y1)
+	void tileRange(int level, const UVRect& visible, int& x0, int& y0, int& x1, int& y1) const;
+};
+
+#endif // !VIRTUALTEXTURE_H_
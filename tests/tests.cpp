@@ -0,0 +1,274 @@
+// Checks of the CPU image & mesh code: run by ctest (see CMakeLists.txt), returns the number of failed checks
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include "imagekernels.h"
+#include "mipchain.h"
+#include "compressedimage.h"
+#include "meshoptimizer.h"
+
+namespace {
+	int Failures = 0;
+
+	void check(bool cond, const char* expr, const char* file, int line) {
+		if (cond) return;
+		printf("%s:%d: check failed: %s\n", file, line, expr);
+		Failures++;
+	}
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+	typedef std::vector<unsigned char> Bytes;
+
+	Bytes randomBytes(std::mt19937& rng, size_t count) {
+		Bytes res(count);
+		for (auto& curr: res) curr = static_cast<unsigned char>(rng());
+		return res;
+	}
+
+	// Every kernel at every level available against the scalar one. Destinations are larger than needed
+	// & filled with a marker, so that writes past the end show up as differences too.
+	void testKernels() {
+		std::vector<ImageKernels::Level> levels = { ImageKernels::supportedLevel() };
+		if (levels[0] == ImageKernels::LevelAVX2) levels.push_back(ImageKernels::LevelSSE2);
+		std::mt19937 rng(1);
+		const int Slack = 64;
+		for (int pixels: { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 100, 255, 256, 257, 1000 }) {
+			size_t bytes = size_t(pixels) * 8 * 4 + Slack;
+			Bytes src = randomBytes(rng, bytes), src2 = randomBytes(rng, bytes);
+			std::vector<int> sums0(bytes);
+			for (auto& curr: sums0) curr = int(rng() % 100000);
+			for (int bpp = 1; bpp <= 4; bpp++) {
+				std::vector<Bytes> res[2];
+				std::vector<int> sums[2];
+				for (int i = 0; i < int(levels.size()) + 1; i++) {
+					ImageKernels::setLevel(i == 0 ? ImageKernels::LevelScalar : levels[i - 1]);
+					std::vector<Bytes> out(8, Bytes(bytes, 0xAB));
+					ImageKernels::rgbToRGBA(src.data(), out[0].data(), pixels);
+					ImageKernels::rgbaToRGB(src.data(), out[1].data(), pixels);
+					ImageKernels::bgrToRGB(src.data(), out[2].data(), pixels);
+					ImageKernels::shrink2(src.data(), src2.data(), out[3].data(), pixels, bpp);
+					ImageKernels::enlargeRow(src.data(), out[4].data(), pixels, bpp, 2);
+					ImageKernels::enlargeRow(src.data(), out[5].data(), pixels / 4, bpp, 5);
+					const unsigned char color[4] = { 12, 34, 56, 78 };
+					ImageKernels::fill(out[6].data(), pixels, bpp, color);
+					std::vector<int> acc = sums0;
+					ImageKernels::accumulate(src.data(), acc.data(), pixels * bpp, 1000 + bpp);
+					if (i == 0) res[0] = out, sums[0] = acc;
+					else {
+						for (int k = 0; k < int(out.size()); k++) {
+							bool same = out[k] == res[0][k];
+							if (!same) printf("  kernel %d, %s, %d pixels of %d bytes\n", k, ImageKernels::levelName(levels[i - 1]), pixels, bpp);
+							CHECK(same);
+						}
+						CHECK(acc == sums[0]);
+					}
+				}
+			}
+		}
+		ImageKernels::setLevel(ImageKernels::supportedLevel());
+	}
+
+	// Reference decoder for the check
+	void decodeColorBlock(const unsigned char* block, bool fourColors, unsigned char* rgba) {
+		int palette[4][4];
+		uint16_t c[2] = { uint16_t(block[0] | block[1] << 8), uint16_t(block[2] | block[3] << 8) };
+		for (int j = 0; j < 2; j++) {
+			int r = c[j] >> 11 & 31, g = c[j] >> 5 & 63, b = c[j] & 31;
+			palette[j][0] = r << 3 | r >> 2, palette[j][1] = g << 2 | g >> 4, palette[j][2] = b << 3 | b >> 2, palette[j][3] = 255;
+		}
+		fourColors = fourColors || c[0] > c[1];
+		for (int k = 0; k < 3; k++) {
+			if (fourColors) {
+				palette[2][k] = (palette[0][k] * 2 + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + palette[1][k] * 2) / 3;
+			} else {
+				palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+				palette[3][k] = 0;
+			}
+		}
+		palette[2][3] = 255, palette[3][3] = fourColors ? 255 : 0;
+		uint32_t indexes = uint32_t(block[4]) | uint32_t(block[5]) << 8 | uint32_t(block[6]) << 16 | uint32_t(block[7]) << 24;
+		for (int i = 0; i < 16; i++)
+			for (int k = 0; k < 4; k++) rgba[i * 4 + k] = static_cast<unsigned char>(palette[indexes >> (i * 2) & 3][k]);
+	}
+
+	void decodeAlphaBlock(const unsigned char* block, unsigned char* rgba) {
+		int a0 = block[0], a1 = block[1], palette[8] = { a0, a1 };
+		for (int j = 1; j < 7; j++) {
+			if (a0 > a1) palette[j + 1] = (a0 * (7 - j) + a1 * j) / 7;
+			else if (j < 5) palette[j + 1] = (a0 * (5 - j) + a1 * j) / 5;
+		}
+		if (a0 <= a1) palette[6] = 0, palette[7] = 255;
+		uint64_t indexes = 0;
+		for (int j = 0; j < 6; j++) indexes |= uint64_t(block[2 + j]) << (j * 8);
+		for (int i = 0; i < 16; i++) rgba[i * 4 + 3] = static_cast<unsigned char>(palette[indexes >> (i * 3) & 7]);
+	}
+
+	// Root mean square error per channel of the base level decoded, over pixels inside the image
+	double blockError(const CompressedImage& image, const TextureImage& source, int channels) {
+		double error = 0.0;
+		int bpp = source.bytesPerPixel();
+		for (int y = 0; y < source.height(); y++) for (int x = 0; x < source.width(); x++) {
+			const unsigned char* block = image.data(0) + size_t(y / 4) * image.pitch(0) + (x / 4) * image.blockBytes();
+			unsigned char rgba[64];
+			if (image.format() == CompressedImage::FormatBC3) {
+				decodeColorBlock(block + 8, true, rgba);
+				decodeAlphaBlock(block, rgba);
+			} else decodeColorBlock(block, false, rgba);
+			int i = y % 4 * 4 + x % 4;
+			for (int k = 0; k < channels; k++) {
+				double d = double(rgba[i * 4 + k]) - source.color(x, y, std::min(k, bpp - 1));
+				error += d * d;
+			}
+		}
+		return std::sqrt(error / (double(source.width()) * source.height() * channels));
+	}
+
+	// Smooth gradients with a little noise, edges not on block boundaries
+	TextureImage testImage(int width, int height, int bpp) {
+		std::mt19937 rng(2);
+		TextureImage res(width, height, bpp);
+		for (int y = 0; y < height; y++) for (int x = 0; x < width; x++) {
+			int noise = int(rng() % 9) - 4;
+			int values[4] = { x * 255 / width + noise, y * 255 / height + noise, (x + y) * 255 / (width + height) + noise, 255 - x * 200 / width };
+			for (int k = 0; k < bpp; k++) res.color(x, y, k) = static_cast<unsigned char>(std::min(std::max(values[k], 0), 255));
+		}
+		return res;
+	}
+
+	void testBlockCompression() {
+		const double MaxColorError = 8.0, MaxAlphaError = 4.0;
+		TextureImage rgb = testImage(37, 21, 3), rgba = testImage(37, 21, 4);
+		CompressedImage bc1(MipChain(rgb), CompressedImage::FormatBC1);
+		CompressedImage bc3(MipChain(rgba), CompressedImage::FormatBC3);
+		CHECK(bc1.levels() == MipChain::fullLevels(37, 21) && bc3.levels() == bc1.levels());
+		CHECK(bc1.size(0) == 10 * 6 * 8 && bc3.size(0) == 10 * 6 * 16);
+		double e1 = blockError(bc1, rgb, 3), e3 = blockError(bc3, rgba, 3), a3 = 0.0;
+		// Alpha alone: compare against an image of alpha in all channels
+		TextureImage alpha(rgba.width(), rgba.height(), 1);
+		for (int y = 0; y < rgba.height(); y++) for (int x = 0; x < rgba.width(); x++) alpha.color(x, y, 0) = rgba.color(x, y, 3);
+		{
+			double error = 0.0;
+			for (int y = 0; y < alpha.height(); y++) for (int x = 0; x < alpha.width(); x++) {
+				unsigned char rgbaBlock[64];
+				decodeAlphaBlock(bc3.data(0) + size_t(y / 4) * bc3.pitch(0) + (x / 4) * 16, rgbaBlock);
+				double d = double(rgbaBlock[(y % 4 * 4 + x % 4) * 4 + 3]) - alpha.color(x, y, 0);
+				error += d * d;
+			}
+			a3 = std::sqrt(error / (double(alpha.width()) * alpha.height()));
+		}
+		printf("  BC1 color RMSE %.2f, BC3 color RMSE %.2f, alpha RMSE %.2f\n", e1, e3, a3);
+		CHECK(e1 < MaxColorError);
+		CHECK(e3 < MaxColorError);
+		CHECK(a3 < MaxAlphaError);
+
+		// Solid blocks round trip exactly for colors representable in 5:6:5
+		TextureImage solid(8, 8, 4);
+		for (int y = 0; y < 8; y++) for (int x = 0; x < 8; x++) {
+			const unsigned char color[4] = { 0xFF, 0x82, 0x00, 0x80 };
+			for (int k = 0; k < 4; k++) solid.color(x, y, k) = color[k];
+		}
+		CompressedImage bc3Solid(MipChain(solid, 1), CompressedImage::FormatBC3);
+		CHECK(blockError(bc3Solid, solid, 4) == 0.0);
+	}
+
+	void testMipChain() {
+		struct Case {
+			int width, height;
+			std::vector<std::pair<int, int>> sizes;
+		};
+		const Case cases[] = {
+			{ 1, 1, { { 1, 1 } } },
+			{ 37, 21, { { 37, 21 }, { 18, 10 }, { 9, 5 }, { 4, 2 }, { 2, 1 }, { 1, 1 } } },
+			{ 1, 100, { { 1, 100 }, { 1, 50 }, { 1, 25 }, { 1, 12 }, { 1, 6 }, { 1, 3 }, { 1, 1 } } },
+			{ 64, 16, { { 64, 16 }, { 32, 8 }, { 16, 4 }, { 8, 2 }, { 4, 1 }, { 2, 1 }, { 1, 1 } } },
+		};
+		for (const Case& curr: cases) {
+			CHECK(MipChain::fullLevels(curr.width, curr.height) == int(curr.sizes.size()));
+			for (int bpp = 1; bpp <= 4; bpp++) {
+				MipChain chain(TextureImage(curr.width, curr.height, bpp));
+				CHECK(chain.levels() == int(curr.sizes.size()));
+				for (int i = 0; i < std::min(chain.levels(), int(curr.sizes.size())); i++) {
+					CHECK(chain.width(i) == curr.sizes[i].first && chain.height(i) == curr.sizes[i].second);
+					CHECK(chain.pitch(i) == TextureImage::alignedPitch(chain.width(i) * bpp) || i == 0);
+				}
+			}
+		}
+		// Limited chains & box filtered values of an even level
+		TextureImage image = testImage(8, 6, 4);
+		MipChain limited(image, 2);
+		CHECK(limited.levels() == 2);
+		const unsigned char* level = limited.data(1);
+		for (int k = 0; k < 4; k++) {
+			int sum = image.color(2, 2, k) + image.color(3, 2, k) + image.color(2, 3, k) + image.color(3, 3, k);
+			CHECK(level[limited.pitch(1) + 4 + k] == sum / 4);
+		}
+	}
+
+	// Triangles as corner positions, rotated so that the smallest corner comes first (winding kept)
+	typedef std::array<std::array<float, 3>, 3> Triangle;
+	Triangle triangle(const float* a, const float* b, const float* c) {
+		Triangle res = { { { { a[0], a[1], a[2] } }, { { b[0], b[1], b[2] } }, { { c[0], c[1], c[2] } } } };
+		std::rotate(res.begin(), std::min_element(res.begin(), res.end()), res.end());
+		return res;
+	}
+
+	void testMeshOptimizer() {
+		// Grid of quads with shared corners repeated per triangle, in shuffled order
+		const int Size = 24;
+		std::vector<Triangle> triangles;
+		for (int y = 0; y < Size; y++) for (int x = 0; x < Size; x++) {
+			float p[4][3];
+			for (int i = 0; i < 4; i++) {
+				int cx = x + i % 2, cy = y + i / 2;
+				p[i][0] = float(cx), p[i][1] = float(cy), p[i][2] = float((cx * 7 + cy * 3) % 5) * 0.5f;
+			}
+			triangles.push_back(triangle(p[0], p[2], p[1]));
+			triangles.push_back(triangle(p[1], p[2], p[3]));
+		}
+		std::shuffle(triangles.begin(), triangles.end(), std::mt19937(3));
+		std::vector<float> vertices;
+		for (const Triangle& curr: triangles) for (const auto& corner: curr) vertices.insert(vertices.end(), corner.begin(), corner.end());
+
+		VertexFormat format(0, 0, 0, 3);
+		MeshOptimizer::Mesh mesh = MeshOptimizer::optimize(format, vertices.data(), int(triangles.size()) * 3);
+		CHECK(mesh.vertexCount == (Size + 1) * (Size + 1));
+		CHECK(mesh.indexes.size() == triangles.size() * 3);
+		CHECK(mesh.vertices.size() == size_t(mesh.vertexCount) * format.vertexSize());
+
+		std::vector<Triangle> res;
+		const float* data = reinterpret_cast<const float*>(mesh.vertices.data());
+		bool inRange = true;
+		for (size_t i = 0; i + 2 < mesh.indexes.size(); i += 3) {
+			const unsigned int* t = &mesh.indexes[i];
+			if (t[0] >= unsigned(mesh.vertexCount) || t[1] >= unsigned(mesh.vertexCount) || t[2] >= unsigned(mesh.vertexCount)) {
+				inRange = false;
+				continue;
+			}
+			res.push_back(triangle(data + t[0] * 3, data + t[1] * 3, data + t[2] * 3));
+		}
+		CHECK(inRange);
+		std::sort(triangles.begin(), triangles.end());
+		std::sort(res.begin(), res.end());
+		CHECK(res == triangles);
+
+		printf("  ACMR %.3f\n", MeshOptimizer::acmr(mesh.indexes.data(), int(mesh.indexes.size())));
+	}
+}
+
+int main() {
+	printf("Image kernels (%s)\n", ImageKernels::levelName(ImageKernels::supportedLevel()));
+	testKernels();
+	printf("Block compression\n");
+	testBlockCompression();
+	printf("Mip chains\n");
+	testMipChain();
+	printf("Mesh optimizer\n");
+	testMeshOptimizer();
+	printf(Failures == 0 ? "All checks passed\n" : "%d checks failed\n", Failures);
+	return Failures == 0 ? 0 : 1;
+}